@@ -0,0 +1,141 @@
+/*
+ * Compares the RVL depth codec of depth_codec.h against 16 bit PNG (as written by cv::imwrite) on the same frames:
+ * encode and decode throughput in MB/s of raw depth, and compression ratio. Both codecs run in memory, so disk
+ * speed does not enter the comparison. Runs on the seq_depthNNNNN.png frames of a recording, or on synthetic frames
+ * if no recording is given.
+ */
+
+#include <depth_codec.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/imgcodecs.hpp>
+#pragma GCC diagnostic pop
+
+#include <cxxopts.hpp>
+
+std::vector<cv::Mat> read_recording(const std::string& source_path, const size_t num_frames)
+{
+    std::vector<cv::Mat> frames;
+    for (size_t index = 0; index < num_frames; ++index) {
+        std::stringstream file_name;
+        file_name << source_path << "seq_depth" << std::setfill('0') << std::setw(5) << index << ".png";
+        cv::Mat depth_map = cv::imread(file_name.str(), cv::IMREAD_ANYDEPTH);
+        if (depth_map.empty())
+            break;
+        if (depth_map.type() != CV_16UC1)
+            throw std::runtime_error{"Depth frames have to be stored as 16 bit PNGs"};
+        frames.push_back(depth_map);
+    }
+    return frames;
+}
+
+// Smooth surfaces with sensor noise and invalid (zero) regions, which is what the codecs are designed for
+std::vector<cv::Mat> make_synthetic_frames(const size_t num_frames)
+{
+    cv::RNG rng { 42 };
+    std::vector<cv::Mat> frames;
+    for (size_t index = 0; index < num_frames; ++index) {
+        cv::Mat_<uint16_t> depth_map(480, 640);
+        const double phase = static_cast<double>(index) * 0.05;
+        for (int y = 0; y < depth_map.rows; ++y) {
+            for (int x = 0; x < depth_map.cols; ++x) {
+                const double depth = 1200.0 + 300.0 * std::sin(x / 80.0 + phase) * std::cos(y / 60.0)
+                                     + rng.gaussian(2.0);
+                const bool invalid = x < 20 || (x / 40 + y / 40 + static_cast<int>(index)) % 11 == 0;
+                depth_map(y, x) = invalid ? 0 : static_cast<uint16_t>(depth);
+            }
+        }
+        frames.push_back(depth_map);
+    }
+    return frames;
+}
+
+// Returns the median time per frame in milliseconds
+double measure(const size_t num_frames, const size_t repetitions, const std::function<void(size_t)>& run)
+{
+    std::vector<double> times;
+    for (size_t repetition = 0; repetition < repetitions; ++repetition) {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t index = 0; index < num_frames; ++index)
+            run(index);
+        const auto elapsed = std::chrono::duration<double, std::milli> { std::chrono::steady_clock::now() - start };
+        times.push_back(elapsed.count() / static_cast<double>(num_frames));
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options { "depth_codec_bench", "Benchmarks the RVL depth codec against PNG" };
+    options.add_options()
+            ("i,input", "Directory containing seq_depthNNNNN.png frames", cxxopts::value<std::string>())
+            ("f,frames", "Number of frames per repetition", cxxopts::value<size_t>()->default_value("50"))
+            ("r,repetitions", "Number of repetitions", cxxopts::value<size_t>()->default_value("5"));
+    auto program_arguments = options.parse(argc, argv);
+
+    const auto num_frames = program_arguments["frames"].as<size_t>();
+    const auto repetitions = std::max<size_t>(program_arguments["repetitions"].as<size_t>(), 1);
+    const auto frames = program_arguments.count("input") > 0 ?
+                        read_recording(program_arguments["input"].as<std::string>(), num_frames) :
+                        make_synthetic_frames(num_frames);
+    if (frames.empty())
+        throw std::runtime_error{"No frames to encode"};
+
+    std::vector<std::vector<uchar>> png_data(frames.size()), rvl_data(frames.size());
+    cv::Mat png_decoded;
+    cv::Mat_<uint16_t> rvl_decoded;
+
+    const double png_encode_time = measure(frames.size(), repetitions, [&](const size_t index) {
+        cv::imencode(".png", frames[index], png_data[index]);
+    });
+    const double png_decode_time = measure(frames.size(), repetitions, [&](const size_t index) {
+        cv::imdecode(png_data[index], cv::IMREAD_ANYDEPTH, &png_decoded);
+    });
+    const double rvl_encode_time = measure(frames.size(), repetitions, [&](const size_t index) {
+        rvl_encode(frames[index], rvl_data[index]);
+    });
+    const double rvl_decode_time = measure(frames.size(), repetitions, [&](const size_t index) {
+        rvl_decode(rvl_data[index].data(), rvl_data[index].size(), rvl_decoded);
+    });
+
+    // Both codecs are lossless
+    size_t raw_size = 0, png_size = 0, rvl_size = 0;
+    for (size_t index = 0; index < frames.size(); ++index) {
+        rvl_decode(rvl_data[index].data(), rvl_data[index].size(), rvl_decoded);
+        if (cv::norm(frames[index], rvl_decoded, cv::NORM_INF) != 0) {
+            std::cerr << "RVL roundtrip of frame " << index << " is not lossless" << std::endl;
+            return EXIT_FAILURE;
+        }
+        raw_size += frames[index].total() * frames[index].elemSize();
+        png_size += png_data[index].size();
+        rvl_size += rvl_data[index].size();
+    }
+
+    const double frame_megabytes = static_cast<double>(raw_size) / static_cast<double>(frames.size()) / 1e6;
+    std::cout << frames.size() << " frames of " << frames[0].cols << "x" << frames[0].rows
+              << ", median of " << repetitions << " repetitions, throughput in MB/s of raw depth" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "  codec    encode MB/s   decode MB/s   ratio" << std::endl;
+    std::cout << "  PNG   " << std::setw(13) << frame_megabytes / png_encode_time * 1000.0
+              << std::setw(14) << frame_megabytes / png_decode_time * 1000.0
+              << std::setw(8) << static_cast<double>(raw_size) / static_cast<double>(png_size) << std::endl;
+    std::cout << "  RVL   " << std::setw(13) << frame_megabytes / rvl_encode_time * 1000.0
+              << std::setw(14) << frame_megabytes / rvl_decode_time * 1000.0
+              << std::setw(8) << static_cast<double>(raw_size) / static_cast<double>(rvl_size) << std::endl;
+
+    return EXIT_SUCCESS;
+}
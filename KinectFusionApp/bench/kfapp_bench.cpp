@@ -0,0 +1,357 @@
+/*
+ * Benchmarks of the application's own code paths, for tracking regressions between releases:
+ * - decoding of recorded frames by PseudoCamera (PNG and RVL depth) and rendering by SyntheticCamera
+ * - the depth and color conversions of the cameras (scaling, Xtion mirroring, decimation)
+ * - the visualization helpers of util.h, checked against the per-pixel implementations they replaced, and that the
+ *   dashboard shows the camera's colors unchanged
+ * - pose and PLY export
+ * All input is synthetic and seeded, so runs are repeatable. Each benchmark is run once to warm up and then
+ * repeatedly; the time per iteration of every repetition is reported, so runs can be compared statistically.
+ * Results are printed as a table and optionally written as JSON:
+ * { "benchmarks": [ { "name": ..., "unit": "ms", "iterations": ..., "median": ..., "samples": [ ... ] } ] }
+ */
+
+#include <dashboard.h>
+#include <depth_camera.h>
+#include <export.h>
+#include <frame_conversion.h>
+#include <synthetic_scene.h>
+#include <util.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+#include <cxxopts.hpp>
+
+struct BenchmarkResult {
+    std::string name;
+    size_t iterations;
+    std::vector<double> samples;    // Milliseconds per iteration, one per repetition
+
+    double median() const
+    {
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+};
+
+class BenchmarkRunner {
+public:
+    BenchmarkRunner(const size_t _repetitions, std::string _filter) :
+            repetitions{_repetitions}, filter{std::move(_filter)}, results{}
+    {
+    }
+
+    // Runs the benchmark if its name contains the filter; run is called with the iteration index
+    void run(const std::string& name, const size_t iterations, const std::function<void(size_t)>& run)
+    {
+        if (name.find(filter) == std::string::npos)
+            return;
+
+        for (size_t index = 0; index < iterations; ++index)
+            run(index);
+
+        BenchmarkResult result { name, iterations, {} };
+        for (size_t repetition = 0; repetition < repetitions; ++repetition) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t index = 0; index < iterations; ++index)
+                run(index);
+            const auto elapsed = std::chrono::duration<double, std::milli> { std::chrono::steady_clock::now() - start };
+            result.samples.push_back(elapsed.count() / static_cast<double>(iterations));
+        }
+
+        std::cout << "  " << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(4)
+                  << std::setw(12) << result.median() << std::setw(12)
+                  << *std::min_element(result.samples.begin(), result.samples.end()) << std::endl;
+        results.push_back(result);
+    }
+
+    void write_json(const std::string& file_name) const
+    {
+        std::ofstream file { file_name };
+        if (!file)
+            throw std::runtime_error{"Result file " + file_name + " could not be created"};
+
+        file << std::setprecision(9) << "{\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& result = results[i];
+            file << (i > 0 ? "," : "") << "\n    { \"name\": \"" << result.name << "\", \"unit\": \"ms\", "
+                 << "\"iterations\": " << result.iterations << ", \"median\": " << result.median()
+                 << ", \"samples\": [";
+            for (size_t j = 0; j < result.samples.size(); ++j)
+                file << (j > 0 ? ", " : "") << result.samples[j];
+            file << "] }";
+        }
+        file << "\n  ]\n}" << std::endl;
+    }
+
+private:
+    size_t repetitions;
+    std::string filter;
+    std::vector<BenchmarkResult> results;
+};
+
+CameraParameters make_parameters()
+{
+    CameraParameters cam_params {};
+    cam_params.image_width = 640;
+    cam_params.image_height = 480;
+    cam_params.focal_x = 525.f;
+    cam_params.focal_y = 525.f;
+    cam_params.principal_x = 319.5f;
+    cam_params.principal_y = 239.5f;
+    return cam_params;
+}
+
+std::unique_ptr<SyntheticCamera> make_synthetic_camera(const size_t num_frames)
+{
+    SensorModel sensor {};
+    sensor.noise_stddev = 2.f;
+    sensor.seed = 42;
+    return std::make_unique<SyntheticCamera>(SyntheticScene::make_default(), OrbitTrajectory {}, make_parameters(),
+                                             num_frames, sensor);
+}
+
+// Records the synthetic sequence in the layout read by PseudoCamera
+void write_sequence(const std::string& directory, const size_t num_frames, const bool compress_depth)
+{
+    make_directories(directory);
+    RecordingCamera recorder { make_synthetic_camera(num_frames), directory, compress_depth, 4,
+                               OverflowPolicy::Block };
+    for (size_t index = 0; index < num_frames; ++index)
+        recorder.grab_frame();
+}
+
+// Normals of a sphere filling the image, with invalid (zero) normals around it
+cv::Mat_<cv::Vec3f> make_normal_map(const int width, const int height)
+{
+    cv::Mat_<cv::Vec3f> normal_map(height, width);
+    const float radius = 0.45f * static_cast<float>(std::min(width, height));
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const float nx = (static_cast<float>(x) - 0.5f * static_cast<float>(width)) / radius;
+            const float ny = (static_cast<float>(y) - 0.5f * static_cast<float>(height)) / radius;
+            const float squared = nx * nx + ny * ny;
+            normal_map(y, x) = squared < 1.f ? cv::Vec3f { nx, ny, -std::sqrt(1.f - squared) } : cv::Vec3f { 0, 0, 0 };
+        }
+    }
+    return normal_map;
+}
+
+// The per-pixel implementation of color_normal() before it was vectorized
+cv::Mat color_normal_reference(const cv::Mat& normal_map)
+{
+    cv::Mat output(normal_map.size(), CV_8UC3);
+    for (int y = 0; y < normal_map.rows; y++) {
+        for (int x = 0; x < normal_map.cols; x++) {
+            auto& col = output.at<cv::Vec3b>(y, x);
+            col[0] = col[1] = col[2] = 255;
+            const auto& normal = normal_map.at<const cv::Vec3f>(y, x);
+            if (normal[2] != 0) {
+                col[0] = static_cast<uchar>((normal[0] + 1) / 2 * 255);
+                col[1] = static_cast<uchar>((normal[1] + 1) / 2 * 255);
+                col[2] = static_cast<uchar>((normal[2] + 1) / 2 * 255);
+            }
+        }
+    }
+    return output;
+}
+
+// The implementation of color_depth() before it was done in a single pass
+cv::Mat color_depth_reference(const cv::Mat& depth_map)
+{
+    cv::Mat output = depth_map.clone();
+    double min, max;
+    cv::minMaxIdx(depth_map, &min, &max);
+    output -= min;
+    cv::convertScaleAbs(output, output, 255 / (max - min));
+    cv::applyColorMap(output, output, cv::COLORMAP_JET);
+    return output;
+}
+
+kinectfusion::PointCloud make_pointcloud(const int num_points)
+{
+    cv::RNG rng { 42 };
+    kinectfusion::PointCloud cloud {};
+    cloud.vertices = cv::Mat(num_points, 1, CV_32FC3);
+    cloud.normals = cv::Mat(num_points, 1, CV_32FC3);
+    cloud.color = cv::Mat(num_points, 1, CV_8UC3);
+    rng.fill(cloud.vertices, cv::RNG::UNIFORM, -1000.f, 1000.f);
+    rng.fill(cloud.normals, cv::RNG::UNIFORM, -1.f, 1.f);
+    rng.fill(cloud.color, cv::RNG::UNIFORM, 0, 256);
+    cloud.num_points = num_points;
+    return cloud;
+}
+
+kinectfusion::SurfaceMesh make_mesh(const int num_triangles)
+{
+    cv::RNG rng { 42 };
+    kinectfusion::SurfaceMesh mesh {};
+    cv::Mat triangles(3 * num_triangles, 1, CV_32FC3), colors(3 * num_triangles, 1, CV_8UC3);
+    rng.fill(triangles, cv::RNG::UNIFORM, -1000.f, 1000.f);
+    rng.fill(colors, cv::RNG::UNIFORM, 0, 256);
+    mesh.triangles = triangles;
+    mesh.colors = colors;
+    mesh.num_vertices = 3 * num_triangles;
+    mesh.num_triangles = num_triangles;
+    return mesh;
+}
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options { "kfapp_bench", "Benchmarks the camera, visualization and export code of KinectFusionApp" };
+    options.add_options()
+            ("o,output", "JSON file to write the results to", cxxopts::value<std::string>())
+            ("f,frames", "Number of frames per repetition", cxxopts::value<size_t>()->default_value("30"))
+            ("r,repetitions", "Number of repetitions", cxxopts::value<size_t>()->default_value("10"))
+            ("filter", "Only run benchmarks whose name contains this", cxxopts::value<std::string>()->default_value(""))
+            ("work-dir", "Directory for the generated recordings and exports",
+             cxxopts::value<std::string>()->default_value("/tmp/kfapp_bench/"));
+    auto program_arguments = options.parse(argc, argv);
+
+    const auto num_frames = std::max<size_t>(program_arguments["frames"].as<size_t>(), 1);
+    BenchmarkRunner runner { std::max<size_t>(program_arguments["repetitions"].as<size_t>(), 1),
+                             program_arguments["filter"].as<std::string>() };
+    std::string work_dir = program_arguments["work-dir"].as<std::string>();
+    if (work_dir.empty() || work_dir.back() != '/')
+        work_dir += '/';
+
+    std::cout << "  " << std::left << std::setw(32) << "benchmark" << std::right
+              << std::setw(12) << "median [ms]" << std::setw(12) << "min [ms]" << std::endl;
+
+    // ### Cameras ###
+    for (const bool compress_depth : { false, true }) {
+        const std::string sequence_dir = work_dir + (compress_depth ? "rvl/" : "png/");
+        write_sequence(sequence_dir, num_frames, compress_depth);
+        PseudoCamera camera { sequence_dir };
+        runner.run(compress_depth ? "pseudo_camera_decode_rvl" : "pseudo_camera_decode_png", num_frames,
+                   [&](const size_t index) {
+                       if (index == 0)
+                           camera.seek(0);
+                       camera.grab_frame();
+                   });
+    }
+
+    const auto synthetic_camera = make_synthetic_camera(num_frames);
+    runner.run("synthetic_camera_render", num_frames, [&](const size_t index) {
+        if (index == 0)
+            synthetic_camera->seek(0);
+        synthetic_camera->grab_frame();
+    });
+
+    // ### Conversions ###
+    const InputFrame frame = make_synthetic_camera(1)->grab_frame();
+    const cv::Mat_<uint16_t> raw_depth = frame.depth_map;
+    const cv::Mat_<cv::Vec3b> raw_color = frame.color_map;
+
+    cv::Mat_<float> depth_map;
+    runner.run("convert_depth", num_frames, [&](size_t) { convert_depth(raw_depth, 0.2f, depth_map); });
+
+    cv::Mat_<uint16_t> mirrored_depth;
+    cv::Mat_<cv::Vec3b> mirrored_color;
+    runner.run("xtion_mirror_depth", num_frames, [&](size_t) { mirror_depth(raw_depth, mirrored_depth); });
+    runner.run("xtion_mirror_swap_channels", num_frames, [&](size_t) {
+        mirror_swap_channels(raw_color, mirrored_color);
+    });
+
+    cv::Mat_<uint16_t> decimated_depth;
+    cv::Mat_<cv::Vec3b> decimated_color;
+    runner.run("decimate_depth_nearest", num_frames, [&](size_t) {
+        decimate_depth(raw_depth, 2, DecimationFilter::Nearest, decimated_depth);
+    });
+    runner.run("decimate_depth_median", num_frames, [&](size_t) {
+        decimate_depth(raw_depth, 2, DecimationFilter::Median, decimated_depth);
+    });
+    runner.run("decimate_color", num_frames, [&](size_t) { decimate_color(raw_color, 2, decimated_color); });
+
+    // ### Visualization ###
+    // The odd size also covers the scalar remainder of each row, which 1280 * 3 components never reach
+    cv::Mat colored_normals;
+    for (const cv::Size size : { cv::Size { 1280, 720 }, cv::Size { 1279, 719 } }) {
+        const cv::Mat_<cv::Vec3f> normals = make_normal_map(size.width, size.height);
+        color_normal(normals, colored_normals);
+        if (cv::norm(color_normal_reference(normals), colored_normals, cv::NORM_INF) != 0) {
+            std::cerr << "color_normal differs from the reference implementation at " << size.width << "x"
+                      << size.height << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    const cv::Mat_<cv::Vec3f> normal_map = make_normal_map(1280, 720);
+    runner.run("color_normal_reference_720p", num_frames, [&](size_t) { color_normal_reference(normal_map); });
+    runner.run("color_normal_720p", num_frames, [&](size_t) { color_normal(normal_map, colored_normals); });
+
+    // Views of an odd width also cover the scalar tail of each row, which the 640 pixel wide frames never reach
+    convert_depth(raw_depth, 1.f, depth_map);
+    const cv::Rect odd_size { 0, 0, raw_depth.cols - 1, raw_depth.rows - 1 };
+    for (const cv::Mat& depth : { cv::Mat { raw_depth }, cv::Mat { depth_map },
+                                  cv::Mat { raw_depth }(odd_size), cv::Mat { depth_map }(odd_size) }) {
+        if (cv::norm(color_depth_reference(depth), color_depth(depth), cv::NORM_INF) != 0) {
+            std::cerr << "color_depth differs from the reference implementation at " << depth.cols << "x"
+                      << depth.rows << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    // A red wall filling the view, so swapped channels would show up as blue
+    SyntheticScene red_wall {};
+    red_wall.add({ SdfPrimitive::Type::Plane, { 0.f, 0.f, 0.f }, { 0.f, 0.f, -1.f }, { 0, 0, 255 } });
+    const InputFrame red_frame = SyntheticCamera { red_wall, OrbitTrajectory {}, make_parameters(), 1, SensorModel {} }
+            .grab_frame();
+    Dashboard dashboard { make_parameters(), 1., 4000.f };
+    DisplayFrame display_frame {};
+    display_frame.color_map = red_frame.color_map;
+    dashboard.update(display_frame);
+    // The color panel is at the bottom left; its top rows hold the label
+    const cv::Size panel_size = dashboard.get_panel_size();
+    const cv::Rect below_label { 0, 24, panel_size.width, panel_size.height - 24 };
+    const cv::Mat color_panel = dashboard.get_canvas()(below_label + cv::Point { 0, panel_size.height });
+    const auto center = red_frame.color_map(panel_size.height / 2, panel_size.width / 2);
+    if (center != cv::Vec3b { 0, 0, 255 } ||
+        cv::norm(color_panel, cv::Mat { red_frame.color_map }(below_label), cv::NORM_INF) != 0) {
+        std::cerr << "The dashboard does not show the color of the camera unchanged" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    cv::Mat colored_depth;
+    runner.run("color_depth_reference", num_frames, [&](size_t) { color_depth_reference(depth_map); });
+    runner.run("color_depth", num_frames, [&](size_t) { color_depth(depth_map); });
+    runner.run("color_depth_fixed_range", num_frames, [&](size_t) {
+        color_depth(depth_map, 0.f, 4000.f, colored_depth);
+    });
+
+    // ### Export ###
+    std::vector<Eigen::Matrix4f> poses;
+    std::vector<size_t> pose_frames;
+    const OrbitTrajectory trajectory {};
+    for (size_t index = 0; index < 100; ++index) {
+        poses.push_back(trajectory.pose(index));
+        pose_frames.push_back(index);
+    }
+    runner.run("export_poses_100", 1, [&](size_t) { export_poses(poses, pose_frames, work_dir + "poses/"); });
+
+    const auto cloud = make_pointcloud(100000);
+    runner.run("export_ply_pointcloud_100k", 1, [&](size_t) {
+        export_pointcloud(cloud, work_dir + "cloud.ply");
+    });
+    const auto mesh = make_mesh(100000);
+    runner.run("export_ply_mesh_100k", 1, [&](size_t) { export_mesh(mesh, work_dir + "mesh.ply"); });
+
+    if (program_arguments.count("output") > 0)
+        runner.write_json(program_arguments["output"].as<std::string>());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/*
+ * Micro-benchmark for the conversion of Xtion frames: compares the fused mirror/channel swap of frame_conversion.h
+ * against the sequence of OpenCV calls it replaces. Runs on frames read from an OpenNI recording (.oni), so no device
+ * has to be attached, or on random frames if no recording is given.
+ */
+
+#include <frame_conversion.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include <OpenNI.h>
+#include <opencv2/imgproc.hpp>
+#pragma GCC diagnostic pop
+
+#include <cxxopts.hpp>
+
+struct RawFrame {
+    cv::Mat depth; // CV_16UC1, as delivered by OpenNI
+    cv::Mat color; // CV_8UC3, as delivered by OpenNI
+};
+
+std::vector<RawFrame> read_recording(const std::string& file_name, const size_t num_frames)
+{
+    openni::OpenNI::initialize();
+
+    openni::Device device;
+    if (device.open(file_name.c_str()) != openni::STATUS_OK)
+        throw std::runtime_error{"OpenNI recording could not be opened"};
+    device.getPlaybackControl()->setRepeatEnabled(false);
+    device.getPlaybackControl()->setSpeed(-1); // Deliver frames on request instead of in real time
+
+    openni::VideoStream depth_stream, color_stream;
+    depth_stream.create(device, openni::SENSOR_DEPTH);
+    color_stream.create(device, openni::SENSOR_COLOR);
+    depth_stream.start();
+    color_stream.start();
+
+    std::vector<RawFrame> frames;
+    openni::VideoFrameRef depth_frame, color_frame;
+    while (frames.size() < num_frames &&
+           depth_stream.readFrame(&depth_frame) == openni::STATUS_OK &&
+           color_stream.readFrame(&color_frame) == openni::STATUS_OK) {
+        RawFrame frame {};
+        frame.depth = cv::Mat { depth_frame.getHeight(), depth_frame.getWidth(), CV_16UC1,
+                                const_cast<void*>(depth_frame.getData()),
+                                static_cast<size_t>(depth_frame.getStrideInBytes()) }.clone();
+        frame.color = cv::Mat { color_frame.getHeight(), color_frame.getWidth(), CV_8UC3,
+                                const_cast<void*>(color_frame.getData()),
+                                static_cast<size_t>(color_frame.getStrideInBytes()) }.clone();
+        frames.push_back(frame);
+    }
+
+    depth_stream.stop();
+    color_stream.stop();
+    device.close();
+    openni::OpenNI::shutdown();
+
+    return frames;
+}
+
+std::vector<RawFrame> make_random_frames(const size_t num_frames)
+{
+    cv::RNG rng { 42 };
+    std::vector<RawFrame> frames(num_frames);
+    for (auto& frame : frames) {
+        frame.depth.create(480, 640, CV_16UC1);
+        frame.color.create(480, 640, CV_8UC3);
+        rng.fill(frame.depth, cv::RNG::UNIFORM, 0, 4000);
+        rng.fill(frame.color, cv::RNG::UNIFORM, 0, 256);
+    }
+    return frames;
+}
+
+// Returns the median time per frame in milliseconds
+double measure(const std::vector<RawFrame>& frames, const size_t repetitions,
+               const std::function<void(const RawFrame&)>& convert)
+{
+    std::vector<double> times;
+    for (size_t repetition = 0; repetition < repetitions; ++repetition) {
+        const auto start = std::chrono::steady_clock::now();
+        for (const auto& frame : frames)
+            convert(frame);
+        const auto elapsed = std::chrono::duration<double, std::milli> { std::chrono::steady_clock::now() - start };
+        times.push_back(elapsed.count() / static_cast<double>(frames.size()));
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options { "xtion_conversion_bench", "Benchmarks the conversion of Xtion frames" };
+    options.add_options()
+            ("i,input", "OpenNI recording (.oni) to read the frames from", cxxopts::value<std::string>())
+            ("f,frames", "Number of frames to convert per repetition", cxxopts::value<size_t>()->default_value("100"))
+            ("r,repetitions", "Number of repetitions", cxxopts::value<size_t>()->default_value("20"));
+    auto program_arguments = options.parse(argc, argv);
+
+    const auto num_frames = program_arguments["frames"].as<size_t>();
+    const auto repetitions = std::max<size_t>(program_arguments["repetitions"].as<size_t>(), 1);
+    const auto frames = program_arguments.count("input") > 0 ?
+                        read_recording(program_arguments["input"].as<std::string>(), num_frames) :
+                        make_random_frames(num_frames);
+    if (frames.empty())
+        throw std::runtime_error{"No frames to convert"};
+
+    // The outputs are reused for all frames, like the pooled buffers of the camera
+    cv::Mat_<float> float_depth_map;
+    cv::Mat_<uint16_t> depth_map, fused_depth_map;
+    cv::Mat_<cv::Vec3b> color_map, fused_color_map;
+
+    // The fused conversion has to produce exactly what the OpenCV calls produce
+    for (const auto& frame : frames) {
+        cv::flip(frame.depth, depth_map, 1);
+        cv::cvtColor(frame.color, color_map, cv::COLOR_BGR2RGB);
+        cv::flip(color_map, color_map, 1);
+        mirror_depth(frame.depth, fused_depth_map);
+        mirror_swap_channels(frame.color, fused_color_map);
+        if (cv::norm(depth_map, fused_depth_map, cv::NORM_INF) != 0 ||
+            cv::norm(color_map, fused_color_map, cv::NORM_INF) != 0) {
+            std::cerr << "Fused conversion does not match the OpenCV conversion" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const double opencv_float_time = measure(frames, repetitions, [&](const RawFrame& frame) {
+        frame.depth.convertTo(float_depth_map, CV_32FC1);
+        cv::flip(float_depth_map, float_depth_map, 1);
+        cv::cvtColor(frame.color, color_map, cv::COLOR_BGR2RGB);
+        cv::flip(color_map, color_map, 1);
+    });
+    const double opencv_time = measure(frames, repetitions, [&](const RawFrame& frame) {
+        cv::flip(frame.depth, depth_map, 1);
+        cv::cvtColor(frame.color, color_map, cv::COLOR_BGR2RGB);
+        cv::flip(color_map, color_map, 1);
+    });
+    const double fused_time = measure(frames, repetitions, [&](const RawFrame& frame) {
+        mirror_depth(frame.depth, fused_depth_map);
+        mirror_swap_channels(frame.color, fused_color_map);
+    });
+
+    const double frame_megabytes = static_cast<double>(frames[0].depth.total() * frames[0].depth.elemSize() +
+                                                       frames[0].color.total() * frames[0].color.elemSize()) / 1e6;
+    std::cout << frames.size() << " frames of " << frames[0].depth.cols << "x" << frames[0].depth.rows
+              << ", median of " << repetitions << " repetitions" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const auto& result : { std::make_pair("convertTo + flip + cvtColor + flip", opencv_float_time),
+                                std::make_pair("flip + cvtColor + flip", opencv_time),
+                                std::make_pair("fused", fused_time) }) {
+        std::cout << "  " << std::left << std::setw(36) << result.first << std::right
+                  << std::setw(8) << result.second << " ms/frame "
+                  << std::setw(10) << frame_megabytes / result.second * 1000.0 << " MB/s" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
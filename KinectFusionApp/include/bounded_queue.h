@@ -0,0 +1,174 @@
+#ifndef KINECTFUSION_BOUNDED_QUEUE_H
+#define KINECTFUSION_BOUNDED_QUEUE_H
+
+/*
+ * Thread-safe FIFO queue with a fixed capacity, used to hand frames from one thread to another.
+ * The storage is allocated once, so pushing and popping does not allocate.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/*
+ * What push() does when the queue is full
+ */
+enum class OverflowPolicy {
+    Block,      // Wait until the consumer made room (keeps all elements)
+    DropOldest, // Replace the oldest queued element (keeps the latest elements)
+    DropNewest  // Discard the element that is being pushed
+};
+
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(const size_t capacity, const OverflowPolicy _policy) :
+            elements(std::max<size_t>(capacity, 1)), policy{_policy}, mutex{}, not_empty{}, not_full{},
+            head{0}, count{0}, closed{false}, pushed{0}, dropped{0}, max_count{0}, count_sum{0}
+    {
+    }
+
+    /*
+     * Adds an element to the back of the queue, handling a full queue according to the overflow policy.
+     * Returns false if the element itself was not queued (dropped, or the queue was closed).
+     */
+    bool push(T element)
+    {
+        std::unique_lock<std::mutex> lock { mutex };
+        if (policy == OverflowPolicy::Block)
+            not_full.wait(lock, [this] { return closed || count < elements.size(); });
+        if (closed)
+            return false;
+
+        ++pushed;
+        if (count == elements.size()) {
+            ++dropped;
+            if (policy == OverflowPolicy::DropNewest)
+                return false;
+
+            // DropOldest: the new element takes the place of the oldest one
+            elements[head] = T {};
+            head = (head + 1) % elements.size();
+            --count;
+        }
+
+        elements[(head + count) % elements.size()] = std::move(element);
+        ++count;
+        max_count = std::max(max_count, count);
+        count_sum += count;
+
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    /*
+     * Blocks until an element is available and moves it into the given one.
+     * Returns false if the queue has been closed and all remaining elements have been popped.
+     */
+    bool pop(T& element)
+    {
+        std::unique_lock<std::mutex> lock { mutex };
+        not_empty.wait(lock, [this] { return closed || count > 0; });
+        if (count == 0)
+            return false;
+
+        take_front(element);
+
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    // Like pop(), but returns false immediately if the queue is empty
+    bool try_pop(T& element)
+    {
+        std::unique_lock<std::mutex> lock { mutex };
+        if (count == 0)
+            return false;
+
+        take_front(element);
+
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    // Wakes up all waiting threads; afterwards, push() fails and pop() only returns the remaining elements
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        return count;
+    }
+
+    // Number of push() calls and number of elements discarded because of a full queue
+    size_t get_pushed() const
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        return pushed;
+    }
+
+    size_t get_dropped() const
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        return dropped;
+    }
+
+    // Largest number of queued elements and average number of queued elements right after a push. A queue that is
+    // usually full belongs to a consumer that is slower than its producer.
+    size_t get_max_size() const
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        return max_count;
+    }
+
+    double get_average_size() const
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        const size_t queued = pushed - (policy == OverflowPolicy::DropNewest ? dropped : 0);
+        return queued > 0 ? static_cast<double>(count_sum) / static_cast<double>(queued) : 0.;
+    }
+
+    size_t capacity() const
+    {
+        return elements.size();
+    }
+
+private:
+    void take_front(T& element)
+    {
+        element = std::move(elements[head]);
+        elements[head] = T {};
+        head = (head + 1) % elements.size();
+        --count;
+    }
+
+    std::vector<T> elements;
+    const OverflowPolicy policy;
+
+    mutable std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+
+    size_t head;
+    size_t count;
+    bool closed;
+
+    size_t pushed;
+    size_t dropped;
+    size_t max_count;
+    size_t count_sum;
+};
+
+#endif //KINECTFUSION_BOUNDED_QUEUE_H
@@ -0,0 +1,69 @@
+#ifndef KINECTFUSION_DASHBOARD_H
+#define KINECTFUSION_DASHBOARD_H
+
+/*
+ * Operator view showing the input depth, normals computed from it, the input color and the rendered model side by
+ * side in one window, with the frame rate and stage latencies overlaid.
+ * All panels are rendered directly into sub-regions of one canvas, which is allocated once, as are all
+ * intermediate buffers, so updating the view does not allocate.
+ */
+
+#include <data_types.h>
+#include <profiling.h>
+
+#include <string>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+using kinectfusion::CameraParameters;
+
+/*
+ * What the fusion stage hands to the visualization: copies at preview size, so the frame itself can be returned
+ * to the camera right away
+ */
+struct DisplayFrame {
+    cv::Mat model_frame;    // CV_8UC3
+    cv::Mat depth_map;      // CV_32FC1 in millimeters; only filled for the dashboard
+    cv::Mat color_map;      // CV_8UC3; empty if the camera does not provide color
+};
+
+class Dashboard {
+public:
+    /*
+     * Each panel has the size of the camera's frames times scale. Depth is colored from 0 (blue) to max_depth (red)
+     * in millimeters, so the colors are stable across frames.
+     */
+    Dashboard(const CameraParameters& cam_params, double scale, float max_depth);
+
+    // Size to which the fusion stage has to resize the frames
+    cv::Size get_panel_size() const;
+
+    // Renders all panels of the given frame into the canvas
+    void update(const DisplayFrame& frame);
+
+    // Replaces the overlay with the given frame rate and stage latencies
+    void set_status(double fps, const std::vector<StageStatistics>& stages);
+
+    const cv::Mat& get_canvas() const;
+
+private:
+    void draw_overlay();
+
+    CameraParameters panel_params;
+    float max_depth;
+    cv::Size panel_size;
+
+    cv::Mat canvas;
+    cv::Mat depth_panel, normal_panel, color_panel, model_panel, overlay;   // Regions of canvas
+
+    cv::Mat normal_map;                 // CV_32FC3, computed from the depth panel
+    std::vector<std::string> status;    // Lines of the overlay
+};
+
+#endif //KINECTFUSION_DASHBOARD_H
@@ -6,7 +6,12 @@
  * Author: Christian Diller
  */
 
+#include <bounded_queue.h>
 #include <data_types.h>
+#include <frame_conversion.h>
+#include <frame_pool.h>
+#include <kfrec.h>
+#include <synthetic_scene.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wall"
@@ -18,16 +23,32 @@
 
 #include <librealsense2/rs.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <vector>
+
 using kinectfusion::CameraParameters;
 
+class FramePrefetcher;
+
 /**
  * Represents a single input frame
  * Packages a depth map with the corresponding RGB color map
- * The depth map is expected to hold float values, the color map 8 bit RGB values
+ * The depth map holds the raw 16 bit sensor values, which are converted into millimeters by multiplying them with
+ * depth_scale (see convert_depth in frame_conversion.h); the color map holds 8 bit RGB values
  */
 struct InputFrame {
-    cv::Mat_<float> depth_map;
+    cv::Mat_<uint16_t> depth_map;
     cv::Mat_<cv::Vec3b> color_map;
+    float depth_scale { 1.f };
+
+    // When the frame was received from the device; only set by cameras capturing in the background
+    std::chrono::steady_clock::time_point capture_time {};
 };
 
 /*
@@ -35,27 +56,293 @@ struct InputFrame {
  */
 class DepthCamera {
 public:
+    // internal_frames is the number of frames the camera holds itself, e.g. while decoding ahead of time
+    explicit DepthCamera(size_t internal_frames = 0, bool _color_enabled = true);
     virtual ~DepthCamera() = default;
 
     virtual InputFrame grab_frame() const = 0;
     virtual CameraParameters get_parameters() const = 0;
+
+    // Whether the camera will not provide any further frames; grab_frame() must not be called afterwards.
+    // Live cameras never end.
+    virtual bool end_of_stream() const;
+
+    // Prints statistics gathered while grabbing frames (e.g. throughput); called once at shutdown
+    virtual void print_statistics(std::ostream& stream) const;
+
+    // Camera-to-world transformation of the frame_number-th frame of the stream (counting from 0), if the camera
+    // provides ground truth for it. Live cameras do not.
+    virtual bool get_ground_truth(size_t frame_number, Eigen::Matrix4f& pose) const;
+
+    // Number of returned frames the caller holds at the same time, e.g. in a queue; 2 (one being processed and one
+    // being grabbed) by default. Grows the frame pool accordingly, so it is not exhausted. Call before grabbing frames.
+    virtual void set_held_frames(size_t held_frames);
+
+    const FramePool& get_frame_pool() const;
+
+    // If color is disabled, it is neither acquired nor decoded and returned frames have an empty color map
+    bool is_color_enabled() const;
+
+protected:
+    // Provides recycled buffers for the frames returned by grab_frame()
+    mutable FramePool frame_pool;
+    const size_t internal_frames;
+
+    const bool color_enabled;
+};
+
+/*
+ * The part of a recording that is replayed: every stride-th frame from start up to (excluding) end.
+ * end is clamped to the number of frames of the recording.
+ */
+struct FrameRange {
+    size_t start { 0 };
+    size_t end { std::numeric_limits<size_t>::max() };
+    size_t stride { 1 };
+    bool loop { false };    // Start over at start instead of ending the stream
+};
+
+/*
+ * Base class for cameras replaying a recording with a known number of frames, which allows to seek to any frame.
+ * Frames are addressed by their index in the recording and produced by decode_frame(). If prefetch_frames is
+ * greater than 0, frames are decoded ahead of time by decode_threads background threads.
+ */
+class RecordedCamera : public DepthCamera {
+public:
+    explicit RecordedCamera(size_t _prefetch_frames = 0, size_t _decode_threads = 1, bool enable_color = true);
+    ~RecordedCamera() override;
+
+    InputFrame grab_frame() const override;
+
+    virtual size_t frame_count() const = 0;
+
+    // Recording time of the given frame in nanoseconds, if the recording provides it; 0 otherwise
+    virtual uint64_t get_timestamp_ns(size_t index) const;
+
+    // Camera-to-world transformation of the given frame, if the recording provides ground truth
+    virtual bool get_ground_truth_pose(size_t index, Eigen::Matrix4f& pose) const;
+
+    // The frames of the stream are those of the range, starting at its start
+    bool get_ground_truth(size_t frame_number, Eigen::Matrix4f& pose) const override;
+
+    // Restricts the replay to the given range and seeks to its start
+    void set_range(const FrameRange& _range);
+    const FrameRange& get_range() const;
+
+    // The next call to grab_frame() returns the frame with the given index; the replay continues from there
+    void seek(size_t index);
+    size_t get_position() const;
+
+    // Index of the frame that follows the given one after the given number of steps; may exceed the range
+    // if it does not loop
+    size_t index_after(size_t index, size_t steps) const;
+
+    bool end_of_stream() const override;
+
+    void print_statistics(std::ostream& stream) const override;
+
+protected:
+    // Fills the given frame with the frame at the given index. Called concurrently by the background threads when
+    // prefetching, which derived classes have to stop by calling stop_prefetching() in their destructor.
+    virtual void decode_frame(size_t index, InputFrame& frame) const = 0;
+
+    bool is_prefetching() const;
+    void stop_prefetching() const;
+
+private:
+    // Returns the index of the frame to be grabbed and moves on to the next one
+    size_t advance() const;
+    size_t range_end() const;
+
+    FrameRange range;
+    mutable size_t position;
+
+    // Started on the first grab_frame() after a seek, decoding from the frame at prefetch_origin on
+    size_t prefetch_frames;
+    size_t decode_threads;
+    mutable size_t prefetch_origin;
+    mutable std::unique_ptr<FramePrefetcher> prefetcher;
+};
+
+/*
+ * Base class for recordings stored as one image file per frame: 16 bit PNG (or RVL-compressed, see depth_codec.h)
+ * depth maps and optional color images. Derived classes index the frames in their constructor, so replaying
+ * does not need to probe the file system.
+ */
+class SequenceCamera : public RecordedCamera {
+public:
+    ~SequenceCamera() override;
+
+    CameraParameters get_parameters() const override;
+    size_t frame_count() const override;
+    uint64_t get_timestamp_ns(size_t index) const override;
+    bool get_ground_truth_pose(size_t index, Eigen::Matrix4f& pose) const override;
+
+protected:
+    SequenceCamera(size_t prefetch_frames, size_t decode_threads, bool enable_color);
+
+    void decode_frame(size_t index, InputFrame& frame) const override;
+
+    struct SequenceFrame {
+        std::string depth_file;
+        std::string color_file;     // Empty if the frame has no color
+        uint64_t timestamp_ns { 0 };
+        bool has_ground_truth { false };
+        Eigen::Matrix<float, 4, 4, Eigen::DontAlign> ground_truth_pose {};
+    };
+
+    CameraParameters cam_params;
+    float depth_scale;
+    std::vector<SequenceFrame> frames;
 };
 
 /*
  * For testing purposes. This camera simply loads depth frames stored on disk.
+ * Depth frames are read from seq_depthNNNNN.png or, if present, RVL-compressed seq_depthNNNNN.rvl files, color
+ * frames from seq_colorNNNNN.png and the camera parameters from seq_cparam.txt.
+ */
+class PseudoCamera : public SequenceCamera {
+public:
+    explicit PseudoCamera(const std::string& data_path, size_t prefetch_frames = 0, size_t decode_threads = 1,
+                          bool enable_color = true);
+};
+
+/*
+ * Replays a sequence of the TUM RGB-D benchmark (https://vision.in.tum.de/data/datasets/rgbd-dataset).
+ * Each depth frame listed in depth.txt is associated with the color frame of rgb.txt and the ground truth pose of
+ * groundtruth.txt closest in time, if they are at most max_time_difference seconds apart. The intrinsics of the
+ * freiburg1/2/3 sensors are chosen by the name of the directory.
  */
-class PseudoCamera : public DepthCamera {
+class TumCamera : public SequenceCamera {
 public:
-    explicit PseudoCamera(const std::string& _data_path);
-    ~PseudoCamera() override = default;
+    explicit TumCamera(const std::string& data_path, size_t prefetch_frames = 0, size_t decode_threads = 1,
+                       double max_time_difference = 0.02, bool enable_color = true);
+};
+
+/*
+ * Replays a sequence of the ICL-NUIM dataset (https://www.doc.ic.ac.uk/~ahanda/VaFRIC/iclnuim.html) in its
+ * TUM RGB-D compatible format: frames are listed in associations.txt, ground truth poses in <name>.gt.freiburg.
+ */
+class IclNuimCamera : public SequenceCamera {
+public:
+    explicit IclNuimCamera(const std::string& data_path, size_t prefetch_frames = 0, size_t decode_threads = 1,
+                           bool enable_color = true);
+};
+
+/*
+ * Replays a .kfrec recording (see kfrec.h), which is memory-mapped instead of being read frame by frame.
+ * The color map and the raw depth map of a returned frame point directly into the mapped file and must not be
+ * written to; RVL-compressed depth is decoded into a pooled buffer.
+ */
+class KfrecCamera : public RecordedCamera {
+public:
+    explicit KfrecCamera(const std::string& file_name, bool enable_color = true);
+    ~KfrecCamera() override = default;
 
     InputFrame grab_frame() const override;
     CameraParameters get_parameters() const override;
 
+    size_t frame_count() const override;
+    uint64_t get_timestamp_ns(size_t index) const override;
+
+protected:
+    void decode_frame(size_t index, InputFrame& frame) const override;
+
+private:
+    KfrecReader reader;
+};
+
+/*
+ * Renders an analytic scene (see synthetic_scene.h) along an orbit around it, so the pipeline can be run and
+ * benchmarked without a device or a recorded dataset. Provides the rendered poses as ground truth.
+ * Each frame is rendered by all cores; if prefetch_frames is greater than 0, render_threads frames are rendered
+ * ahead of time in parallel instead.
+ */
+class SyntheticCamera : public RecordedCamera {
+public:
+    SyntheticCamera(const SyntheticScene& _scene, const OrbitTrajectory& _trajectory,
+                    const CameraParameters& _cam_params, size_t _frame_count, const SensorModel& _sensor,
+                    size_t prefetch_frames = 0, size_t render_threads = 1, bool enable_color = true);
+    ~SyntheticCamera() override;
+
+    CameraParameters get_parameters() const override;
+    size_t frame_count() const override;
+    bool get_ground_truth_pose(size_t index, Eigen::Matrix4f& pose) const override;
+
+protected:
+    void decode_frame(size_t index, InputFrame& frame) const override;
+
 private:
-    std::string data_path;
+    SyntheticScene scene;
+    OrbitTrajectory trajectory;
+    CameraParameters cam_params;
+    size_t total_frames;
+    SensorModel sensor;
+};
+
+/*
+ * Records the frames of another camera to disk while passing them on unchanged (color is recorded if the other
+ * camera provides it).
+ * Frames are copied into pooled buffers and written by a background thread in the layout PseudoCamera reads
+ * (seq_cparam.txt, seq_depthNNNNN.png or .rvl, seq_colorNNNNN.png), so recording does not slow down grab_frame().
+ * If the disk cannot keep up, the write queue applies its overflow policy: OverflowPolicy::DropNewest skips frames
+ * (the recording stays contiguous, but has gaps in time), OverflowPolicy::Block slows the caller down instead.
+ */
+class RecordingCamera : public DepthCamera {
+public:
+    RecordingCamera(std::unique_ptr<DepthCamera> _camera, const std::string& _output_path, bool _compress_depth,
+                    size_t queue_size = 32, OverflowPolicy policy = OverflowPolicy::DropNewest);
+    ~RecordingCamera() override;
+
+    InputFrame grab_frame() const override;
+    CameraParameters get_parameters() const override;
+    bool end_of_stream() const override;
+    bool get_ground_truth(size_t frame_number, Eigen::Matrix4f& pose) const override;
+
+    void set_held_frames(size_t held_frames) override;
+
+    void print_statistics(std::ostream& stream) const override;
+
+private:
+    void writer_loop();
+
+    std::unique_ptr<DepthCamera> camera;
+    std::string output_path;
+    bool compress_depth;
+
+    mutable BoundedQueue<InputFrame> write_queue;
+    std::thread writer_thread;
+
+    // Statistics, updated by the writer thread
+    std::chrono::steady_clock::time_point start_time;
+    std::atomic<size_t> frames_written;
+    std::atomic<size_t> bytes_written;
+    std::atomic<int64_t> write_time_ns;
+};
+
+/*
+ * Crops the frames of another camera to a region of interest and reduces their resolution by factor (1, 2 or 4),
+ * with the camera parameters adjusted accordingly (see decimate_depth in frame_conversion.h).
+ * An empty region of interest keeps the whole frame.
+ */
+class ResampledCamera : public DepthCamera {
+public:
+    ResampledCamera(std::unique_ptr<DepthCamera> _camera, const cv::Rect& _roi, int _factor, DecimationFilter _filter);
+    ~ResampledCamera() override = default;
+
+    InputFrame grab_frame() const override;
+    CameraParameters get_parameters() const override;
+    bool end_of_stream() const override;
+    bool get_ground_truth(size_t frame_number, Eigen::Matrix4f& pose) const override;
+
+    void print_statistics(std::ostream& stream) const override;
+
+private:
+    std::unique_ptr<DepthCamera> camera;
+    cv::Rect roi;
+    int factor;
+    DecimationFilter filter;
     CameraParameters cam_params;
-    mutable size_t current_index;
 };
 
 /*
@@ -63,7 +350,7 @@ private:
  */
 class XtionCamera : public DepthCamera {
 public:
-    XtionCamera();
+    explicit XtionCamera(bool enable_color = true);
     ~XtionCamera() override = default;
 
     InputFrame grab_frame() const override;
@@ -71,6 +358,8 @@ public:
     CameraParameters get_parameters() const override;
 
 private:
+    void start_color_stream();
+
     openni::Device device;
     mutable openni::VideoStream depthStream;
     mutable openni::VideoStream colorStream;
@@ -82,23 +371,53 @@ private:
 
 /*
  * Provides depth frames acquired by an Intel Realsense camera.
+ * By default, frames are waited for in grab_frame() and copied out of the buffers of librealsense, so returned frames
+ * stay valid while further frames are grabbed.
+ * If capture_queue_size is greater than 0, a background thread continuously copies incoming frames into a queue of
+ * that size instead. With OverflowPolicy::DropOldest, grab_frame() returns the freshest queued frame and skips the
+ * older ones, which are also dropped if processing is too slow; with OverflowPolicy::Block, grab_frame() takes the
+ * oldest queued frame and no frame is dropped by the queue (but librealsense may drop frames itself).
  */
 class RealSenseCamera : public DepthCamera {
 public:
-    RealSenseCamera();
-    RealSenseCamera(const std::string& filename);
+    explicit RealSenseCamera(size_t capture_queue_size = 0,
+                             OverflowPolicy capture_policy = OverflowPolicy::DropOldest, bool enable_color = true);
+    explicit RealSenseCamera(const std::string& filename, size_t capture_queue_size = 0,
+                             OverflowPolicy capture_policy = OverflowPolicy::DropOldest, bool enable_color = true);
 
-    ~RealSenseCamera() override = default;
+    ~RealSenseCamera() override;
 
     InputFrame grab_frame() const override;
 
     CameraParameters get_parameters() const override;
 
+    void print_statistics(std::ostream& stream) const override;
+
 private:
+    void start_capture(size_t capture_queue_size, OverflowPolicy capture_policy);
+    void capture_loop();
+    InputFrame wrap_frames(const rs2::frameset& frameset) const;
+    InputFrame copy_frames(const rs2::frameset& frameset) const;
+
     rs2::pipeline pipeline;
     CameraParameters cam_params;
 
     float depth_scale;
+
+    // Background capture
+    std::unique_ptr<BoundedQueue<InputFrame>> capture_queue;
+    OverflowPolicy capture_policy;
+    std::atomic<bool> stop_capture;
+    std::thread capture_thread;
+    std::exception_ptr capture_error;
+
+    // Queued frames grab_frame() skipped in favor of a fresher one
+    mutable size_t skipped_count;
+
+    // Time between capturing a frame and handing it out in grab_frame(), in milliseconds
+    mutable size_t latency_count;
+    mutable double latency_sum;
+    mutable double latency_max;
 };
 
 
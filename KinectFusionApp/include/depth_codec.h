@@ -0,0 +1,44 @@
+#ifndef KINECTFUSION_DEPTH_CODEC_H
+#define KINECTFUSION_DEPTH_CODEC_H
+
+/*
+ * Lossless compression for 16 bit depth maps, following the RVL scheme ("Fast Lossless Depth Image Compression",
+ * Wilson 2017): runs of zeros and runs of valid values are stored as run lengths, valid values as the difference to
+ * the previous valid value, and all numbers as variable-length nibbles. This is much faster than PNG for both
+ * encoding and decoding and achieves comparable compression on sensor depth.
+ * The image is split into independently coded stripes of rows, so decoding runs in parallel.
+ *
+ * Encoded layout: RvlHeader | uint32_t offsets[stripe_count + 1] (relative to the payload) | payload
+ */
+
+#include <cstdint>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+constexpr char rvl_magic[4] = { 'R', 'V', 'L', '1' };
+
+struct RvlHeader {
+    char magic[4];
+    uint32_t width, height;
+    uint32_t stripe_rows;
+    uint32_t stripe_count;
+};
+
+/*
+ * Encodes a CV_16UC1 depth map, replacing the content of buffer (whose storage is reused)
+ */
+void rvl_encode(const cv::Mat& depth_map, std::vector<uchar>& buffer);
+
+/*
+ * Decodes an encoded depth map into depth_map, reusing its storage if the dimensions match.
+ * Throws std::runtime_error if the data is not a valid encoding.
+ */
+void rvl_decode(const uchar* data, size_t size, cv::Mat_<uint16_t>& depth_map);
+
+#endif //KINECTFUSION_DEPTH_CODEC_H
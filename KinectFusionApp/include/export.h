@@ -0,0 +1,40 @@
+#ifndef KINECTFUSION_EXPORT_H
+#define KINECTFUSION_EXPORT_H
+
+/*
+ * Writing the results of the pipeline to disk. Missing directories are created.
+ */
+
+#include <depth_camera.h>
+#include <kinectfusion.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * Writes each pose into its own file <directory><prefix>NNNNN.txt, numbered by its position in poses, and the
+ * number of the stream frame each pose belongs to into <directory><prefix>_frames.txt, one per line in the same
+ * order. The pipeline only stores poses of frames it could track, so the two numbers differ after a failed frame.
+ */
+void export_poses(const std::vector<Eigen::Matrix4f>& poses, const std::vector<size_t>& frame_numbers,
+                  const std::string& directory, const std::string& prefix = "seq_pose");
+
+/*
+ * Writes the ground truth poses of the given frames of the stream as <directory>seq_gt_poseNNNNN.txt, numbered like
+ * the exported poses of these frames. Frames without ground truth get a zero matrix.
+ * Returns false (and writes nothing) if the camera provides ground truth for none of the frames.
+ */
+bool export_ground_truth_poses(const DepthCamera& camera, const std::vector<size_t>& frame_numbers,
+                               const std::string& directory);
+
+void export_mesh(const kinectfusion::SurfaceMesh& mesh, const std::string& file_name);
+
+void export_pointcloud(const kinectfusion::PointCloud& cloud, const std::string& file_name);
+
+/*
+ * Creates the given directory and its parents if they do not exist yet; everything after the last '/' is ignored,
+ * so file names can be passed as well
+ */
+void make_directories(const std::string& path);
+
+#endif //KINECTFUSION_EXPORT_H
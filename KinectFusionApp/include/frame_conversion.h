@@ -0,0 +1,65 @@
+#ifndef KINECTFUSION_FRAME_CONVERSION_H
+#define KINECTFUSION_FRAME_CONVERSION_H
+
+/*
+ * Conversions between the raw data delivered by the cameras and the input expected by the pipeline
+ */
+
+#include <data_types.h>
+
+#include <cstdint>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+using kinectfusion::CameraParameters;
+
+/*
+ * Converts a raw 16 bit depth map into a float depth map in millimeters, scaling all values by depth_scale in the
+ * same pass. The storage of depth_map is reused if it already has the right dimensions.
+ */
+void convert_depth(const cv::Mat_<uint16_t>& raw_depth_map, float depth_scale, cv::Mat_<float>& depth_map);
+
+/*
+ * Mirrors a CV_16UC1 depth map horizontally in a single pass.
+ * Equivalent to cv::flip(raw_depth_map, depth_map, 1).
+ */
+void mirror_depth(const cv::Mat& raw_depth_map, cv::Mat_<uint16_t>& depth_map);
+
+/*
+ * Mirrors a CV_8UC3 image horizontally and swaps its first and third channel in a single pass.
+ * Equivalent to cv::cvtColor(raw_color_map, color_map, cv::COLOR_BGR2RGB) followed by cv::flip(color_map, color_map, 1).
+ */
+void mirror_swap_channels(const cv::Mat& raw_color_map, cv::Mat_<cv::Vec3b>& color_map);
+
+/*
+ * How decimate_depth() combines each block of pixels into one
+ */
+enum class DecimationFilter {
+    Nearest,    // The pixel at the center of the block (rounded towards the upper left)
+    Median      // The median of the valid (non-zero) depth values of the block; 0 if there are none
+};
+
+/*
+ * Reduces the resolution of a depth map by factor in both dimensions; trailing rows and columns that do not fill a
+ * whole block are dropped. depth_map may be a view into a larger image (e.g. a region of interest).
+ */
+void decimate_depth(const cv::Mat_<uint16_t>& depth_map, int factor, DecimationFilter filter,
+                    cv::Mat_<uint16_t>& decimated);
+
+/*
+ * Reduces the resolution of a color map like decimate_depth() with DecimationFilter::Nearest
+ */
+void decimate_color(const cv::Mat_<cv::Vec3b>& color_map, int factor, cv::Mat_<cv::Vec3b>& decimated);
+
+/*
+ * Camera parameters of the images produced by cropping to roi and decimating with decimate_depth()
+ */
+CameraParameters resample_parameters(const CameraParameters& cam_params, const cv::Rect& roi, int factor,
+                                     DecimationFilter filter);
+
+#endif //KINECTFUSION_FRAME_CONVERSION_H
@@ -0,0 +1,59 @@
+#ifndef KINECTFUSION_FRAME_POOL_H
+#define KINECTFUSION_FRAME_POOL_H
+
+/*
+ * Recycles the buffers of input frames, so that capturing does not allocate once the pool is warmed up.
+ * A frame handed out by the pool shares its buffers with the pool. The buffers return to the pool as soon as the
+ * last copy of the frame (or of one of its matrices) is destroyed, which is detected through the reference counts
+ * of the matrices, so frames can be passed around like any other InputFrame.
+ */
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct InputFrame;
+
+class FramePool {
+public:
+    // The pool keeps at most capacity frames; requests beyond that are served by unpooled allocations
+    explicit FramePool(size_t capacity = 16);
+
+    // Lets the pool keep up to capacity frames, if it keeps fewer so far. Thread-safe.
+    void reserve(size_t capacity);
+
+    /*
+     * Returns a frame whose depth and color maps have the given dimensions. The content of the maps is undefined.
+     * An empty color size returns a frame without color map. Thread-safe.
+     */
+    InputFrame acquire(cv::Size depth_size, cv::Size color_size);
+
+    // Number of requests served from a recycled frame and number of requests that had to allocate
+    size_t get_hits() const;
+    size_t get_misses() const;
+
+    // Whether no one but the owner of the given matrix references its buffer
+    static bool is_unused(const cv::Mat& mat);
+
+private:
+    struct Buffers {
+        cv::Mat depth_map;
+        cv::Mat color_map;
+    };
+
+    size_t capacity;
+    std::vector<Buffers> buffers;
+    std::mutex mutex;
+
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+};
+
+#endif //KINECTFUSION_FRAME_POOL_H
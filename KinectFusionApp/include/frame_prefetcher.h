@@ -0,0 +1,72 @@
+#ifndef KINECTFUSION_FRAME_PREFETCHER_H
+#define KINECTFUSION_FRAME_PREFETCHER_H
+
+/*
+ * Background decoding of input frames into a fixed ring of slots.
+ * Used by cameras whose frames are expensive to produce (e.g. decoding images from disk), so that the
+ * decoding overlaps with the processing of the previous frames instead of adding to it.
+ */
+
+#include <depth_camera.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+class FramePrefetcher {
+public:
+    /*
+     * Fills the given (empty) slot with the frame at the given position of the sequence (counting from 0).
+     * Called concurrently from all worker threads, each time with a different slot. Exceptions are rethrown by
+     * next() when the frame is handed out.
+     */
+    using DecodeFunction = std::function<void(size_t sequence_number, InputFrame& slot)>;
+
+    /*
+     * Starts the worker threads, which will decode up to capacity frames ahead of the consumer.
+     * Frames are decoded out of order by the workers, but always handed out in sequence order.
+     */
+    FramePrefetcher(size_t capacity, size_t num_workers, DecodeFunction decode);
+    ~FramePrefetcher();
+
+    FramePrefetcher(const FramePrefetcher&) = delete;
+    FramePrefetcher& operator=(const FramePrefetcher&) = delete;
+
+    // Blocks until the next frame has been decoded and returns it; rethrows the exception if decoding it failed
+    InputFrame next();
+
+    // Prints the achieved decode throughput and how busy the workers were
+    void print_statistics(std::ostream& stream) const;
+
+private:
+    void worker_loop();
+
+    std::vector<InputFrame> slots;
+    std::vector<bool> slot_ready;
+    std::vector<std::exception_ptr> slot_errors;
+    DecodeFunction decode;
+
+    mutable std::mutex mutex;
+    std::condition_variable slot_decoded;
+    std::condition_variable slot_released;
+
+    // Monotonic counters; frame i lives at slots[i % slots.size()]
+    size_t claimed_count;   // Number of frames handed to a worker
+    size_t decoded_count;   // Number of frames decoded without any gaps in the sequence
+    size_t released_count;  // Number of frames the consumer is done with
+    bool holds_slot;        // Whether the consumer currently holds the slot at released_count
+    bool stop;
+
+    // Statistics
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::duration busy_time;  // Summed up over all workers
+
+    std::vector<std::thread> workers;
+};
+
+#endif //KINECTFUSION_FRAME_PREFETCHER_H
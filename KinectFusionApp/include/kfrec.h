@@ -0,0 +1,125 @@
+#ifndef KINECTFUSION_KFREC_H
+#define KINECTFUSION_KFREC_H
+
+/*
+ * The .kfrec recording container: a single file holding the camera parameters, a frame index table and the
+ * depth (uint16, mm; raw or RVL-compressed) and color (8 bit BGR) payloads of a recorded sequence.
+ * Layout: header | payloads (each aligned to kfrec_alignment bytes) | frame index table
+ * All values are stored in the byte order of the writing machine (little endian on x86).
+ * The reader maps the file into memory, so frames can be handed out without reading or copying them.
+ */
+
+#include <data_types.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+using kinectfusion::CameraParameters;
+
+constexpr char kfrec_magic[8] = { 'K', 'F', 'R', 'E', 'C', '\0', '\0', '\0' };
+constexpr uint32_t kfrec_version = 1;
+constexpr uint64_t kfrec_alignment = 64;
+
+enum class KfrecDepthEncoding : uint32_t {
+    Raw = 0,    // width * height uint16 values
+    Rvl = 1     // Encoded by rvl_encode (see depth_codec.h)
+};
+
+struct KfrecHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t depth_encoding;
+    uint64_t frame_count;
+    uint64_t index_offset;
+
+    int32_t image_width, image_height;
+    float focal_x, focal_y;
+    float principal_x, principal_y;
+};
+static_assert(sizeof(KfrecHeader) == 56, "Unexpected padding in KfrecHeader");
+
+struct KfrecFrameEntry {
+    uint64_t depth_offset, depth_size;
+    uint64_t color_offset, color_size;  // color_size is 0 for frames without color
+    uint64_t timestamp_ns;              // 0 if unknown
+};
+static_assert(sizeof(KfrecFrameEntry) == 40, "Unexpected padding in KfrecFrameEntry");
+
+/*
+ * Read-only, memory-mapped view of a .kfrec file
+ */
+class KfrecReader {
+public:
+    explicit KfrecReader(const std::string& file_name);
+    ~KfrecReader();
+
+    KfrecReader(const KfrecReader&) = delete;
+    KfrecReader& operator=(const KfrecReader&) = delete;
+
+    size_t frame_count() const;
+    CameraParameters get_parameters() const;
+    KfrecDepthEncoding get_depth_encoding() const;
+    const KfrecFrameEntry& get_entry(size_t index) const;
+
+    // Both wrap the mapped pages without copying; the returned matrices must not be written to and are only
+    // valid as long as the reader exists. get_depth() is only available for raw depth.
+    cv::Mat get_depth(size_t index) const;  // CV_16UC1
+    cv::Mat get_color(size_t index) const;  // CV_8UC3, empty if the frame has no color
+
+    // Copies or decodes the depth map of the given frame, reusing the storage of depth_map; works for all encodings
+    void decode_depth(size_t index, cv::Mat_<uint16_t>& depth_map) const;
+
+    // Hints the kernel to read the pages of the given frame ahead of time
+    void prefetch(size_t index) const;
+
+private:
+    // Checks the header and that the index table and all payloads lie within the file
+    bool is_valid();
+
+    const unsigned char* data;
+    size_t size;
+
+    KfrecHeader header;
+    const KfrecFrameEntry* entries;
+};
+
+/*
+ * Writes a .kfrec file frame by frame; the index table is appended by finish()
+ */
+class KfrecWriter {
+public:
+    KfrecWriter(const std::string& file_name, const CameraParameters& camera_parameters,
+                KfrecDepthEncoding depth_encoding = KfrecDepthEncoding::Raw);
+    ~KfrecWriter();
+
+    KfrecWriter(const KfrecWriter&) = delete;
+    KfrecWriter& operator=(const KfrecWriter&) = delete;
+
+    // Expects a CV_16UC1 depth map and a CV_8UC3 (or empty) color map with the dimensions of the camera parameters.
+    // Throws std::runtime_error if the frame could not be written, as does finish().
+    void write_frame(const cv::Mat& depth_map, const cv::Mat& color_map, uint64_t timestamp_ns = 0);
+
+    // Writes the index table and the final header. Called by the destructor if omitted, which ignores any errors.
+    void finish();
+
+private:
+    uint64_t write_payload(const unsigned char* payload, size_t row_size, int rows, size_t step);
+    uint64_t write_payload(const cv::Mat& image);
+
+    std::ofstream file;
+    KfrecHeader header;
+    std::vector<KfrecFrameEntry> entries;
+    std::vector<unsigned char> encoded_depth;
+    bool finished;
+};
+
+#endif //KINECTFUSION_KFREC_H
@@ -0,0 +1,145 @@
+#ifndef KINECTFUSION_PROFILING_H
+#define KINECTFUSION_PROFILING_H
+
+/*
+ * Lightweight latency instrumentation, cheap enough to stay enabled.
+ * Code sections are measured by a ScopedTimer for a named stage. Each thread records into its own histograms, so
+ * recording takes no locks and shares no cache lines with other threads; the histograms of all threads are only
+ * merged when the statistics are collected.
+ * Optionally, the Tracer additionally keeps every measurement as a timeline event for Chrome's trace viewer.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Histogram of durations in nanoseconds with log-linear buckets: every power of two is split into 16 linear
+ * sub-buckets, so percentiles are accurate to about 3% over the full range of values at a fixed size.
+ * Recording is meant to be done by a single thread, while others may read concurrently.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t nanoseconds);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const;
+    uint64_t sum() const;
+    uint64_t max() const;
+
+    // Value below which the given fraction (0 to 1) of the recorded values lies, estimated by the bucket center
+    uint64_t percentile(double fraction) const;
+
+private:
+    static constexpr int sub_bucket_bits = 4;
+    static constexpr int sub_buckets = 1 << sub_bucket_bits;
+    static constexpr int bucket_count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+    static int bucket_index(uint64_t value);
+    static uint64_t bucket_lower_bound(int index);
+
+    std::array<std::atomic<uint64_t>, bucket_count> counts;
+    std::atomic<uint64_t> total_count;
+    std::atomic<uint64_t> total_sum;
+    std::atomic<uint64_t> max_value;
+};
+
+struct StageStatistics {
+    std::string name;
+    uint64_t count;
+    double mean_ms;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double max_ms;
+};
+
+class Profiler {
+public:
+    // Returns the id of the stage with the given name, registering it if it is new. Thread-safe.
+    static size_t register_stage(const std::string& name);
+
+    // Records a duration of the given stage for the calling thread
+    static void record(size_t stage, uint64_t nanoseconds);
+
+    // Statistics of all stages with at least one measurement, merged over all threads
+    static std::vector<StageStatistics> collect();
+
+    static void print(std::ostream& stream);
+    static void write_json(const std::string& file_name);
+    static void write_csv(const std::string& file_name);
+};
+
+/*
+ * Timeline of the measured stages and of counters (e.g. queue depths), written in the Chrome trace event format,
+ * which can be viewed in chrome://tracing or Perfetto. Every thread writes its events into its own ring buffer
+ * without locks; once a ring is full, its oldest events are overwritten. Stage and counter names share the
+ * registry of the Profiler.
+ */
+class Tracer {
+public:
+    // Starts recording; the timeline starts now. Each thread allocates its ring on its first event.
+    static void enable(size_t events_per_thread = 1 << 17);
+    static bool is_enabled()
+    {
+        return enabled.load(std::memory_order_acquire);
+    }
+
+    // Names the calling thread in the timeline
+    static void set_thread_name(const std::string& name);
+
+    static void span(size_t stage, std::chrono::steady_clock::time_point start, uint64_t nanoseconds);
+    static void counter(size_t counter, int64_t value);
+
+    /*
+     * Writes the events of all threads. Must only be called when no thread records anymore.
+     * Returns the number of events that were lost because a ring was full.
+     */
+    static size_t write_chrome_trace(const std::string& file_name);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+/*
+ * Measures the time from its construction to its destruction (or to stop()) as one value of the given stage
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const size_t _stage) : stage{_stage}, start{std::chrono::steady_clock::now()}, running{true}
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        stop();
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        const auto nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        Profiler::record(stage, nanoseconds);
+        if (Tracer::is_enabled())
+            Tracer::span(stage, start, nanoseconds);
+    }
+
+private:
+    const size_t stage;
+    const std::chrono::steady_clock::time_point start;
+    bool running;
+};
+
+#endif //KINECTFUSION_PROFILING_H
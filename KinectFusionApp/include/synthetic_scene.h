@@ -0,0 +1,91 @@
+#ifndef KINECTFUSION_SYNTHETIC_SCENE_H
+#define KINECTFUSION_SYNTHETIC_SCENE_H
+
+/*
+ * Analytic scenes for rendering synthetic depth frames, used by SyntheticCamera.
+ * A scene is a union of primitives given by their signed distance functions (SDF), rendered by sphere tracing.
+ * All lengths are in millimeters; scene coordinates follow the camera convention (x right, y down, z forward).
+ */
+
+#include <data_types.h>
+
+#include <cstdint>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <Eigen/Core>
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+using kinectfusion::CameraParameters;
+
+struct SdfPrimitive {
+    enum class Type {
+        Sphere, // Centered at position, with radius size.x()
+        Box,    // Centered at position, with half the edge lengths in size
+        Plane   // Through position, with the unit normal in size
+    };
+
+    Type type;
+    Eigen::Vector3f position;
+    Eigen::Vector3f size;
+    cv::Vec3b color;    // BGR
+
+    float distance(const Eigen::Vector3f& point) const;
+};
+
+/*
+ * Camera path circling around a center point while looking at it.
+ * The first pose is at center - radius along z (raised by height) and looks along +z.
+ */
+struct OrbitTrajectory {
+    Eigen::Vector3f center { 0.f, 0.f, 0.f };
+    float radius { 1000.f };
+    float height { 0.f };               // Above the center, i.e. along -y
+    float degrees_per_frame { 1.f };
+
+    // Camera-to-scene transformation of the given frame
+    Eigen::Matrix4f pose(size_t index) const;
+};
+
+/*
+ * How depth sensor measurements are imitated when rendering
+ */
+struct SensorModel {
+    float max_depth { 8000.f };     // Surfaces further away are not measured (depth 0)
+    float noise_stddev { 0.f };     // Standard deviation of the depth noise at 1m; grows quadratically with the depth
+    uint32_t seed { 0 };            // Noise is reproducible for a given seed and frame
+};
+
+class SyntheticScene {
+public:
+    void add(const SdfPrimitive& primitive);
+    bool empty() const;
+
+    // Signed distance to the closest surface and the index of the closest primitive
+    float distance(const Eigen::Vector3f& point, size_t& closest) const;
+
+    /*
+     * Renders the scene as seen from the given pose into the given (possibly empty) buffers.
+     * Depth is in millimeters (0 for no measurement), color is shaded by the angle of view onto the surface and
+     * only rendered if color_map is not null. If parallel is set, the rows are rendered by multiple threads.
+     */
+    void render(const Eigen::Matrix4f& pose, const CameraParameters& cam_params, const SensorModel& sensor,
+                size_t frame_index, cv::Mat_<uint16_t>& depth_map, cv::Mat_<cv::Vec3b>* color_map,
+                bool parallel) const;
+
+    // Floor, box and two spheres around the origin, fitting into the default volume
+    static SyntheticScene make_default();
+
+private:
+    void render_rows(const Eigen::Matrix4f& pose, const CameraParameters& cam_params, const SensorModel& sensor,
+                     size_t frame_index, int first_row, int last_row,
+                     cv::Mat_<uint16_t>& depth_map, cv::Mat_<cv::Vec3b>* color_map) const;
+
+    std::vector<SdfPrimitive> primitives;
+};
+
+#endif //KINECTFUSION_SYNTHETIC_SCENE_H
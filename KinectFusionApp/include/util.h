@@ -1,7 +1,12 @@
-
 #ifndef KINECTFUSION_UTIL_H
 #define KINECTFUSION_UTIL_H
 
+/*
+ * Conversions of the pipeline's output for visualization
+ */
+
+#include <data_types.h>
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wall"
 #pragma GCC diagnostic ignored "-Wextra"
@@ -9,33 +14,30 @@
 #include <opencv2/imgproc.hpp>
 #pragma GCC diagnostic pop
 
-cv::Mat color_normal(const cv::Mat& normal_map)
-{
-    cv::Mat output(normal_map.size(), CV_8UC3);
-    for (int y = 0; y < normal_map.rows; y++) {
-        for (int x = 0; x < normal_map.cols; x++) {
-            auto& col = output.at<cv::Vec3b>(y, x);
-            col[0] = col[1] = col[2] = 255;
-            const auto& normal = normal_map.at<const cv::Vec3f>(y, x);
-            if (normal[2] != 0) {
-                col[0] = static_cast<uchar>((normal[0] + 1) / 2 * 255);
-                col[1] = static_cast<uchar>((normal[1] + 1) / 2 * 255);
-                col[2] = static_cast<uchar>((normal[2] + 1) / 2 * 255);
-            }
-        }
-    }
-    return output;
-}
-
-cv::Mat color_depth(const cv::Mat& depth_map)
-{
-    cv::Mat output = depth_map.clone();
-    double min, max;
-    cv::minMaxIdx(depth_map, &min, &max);
-    output -= min;
-    cv::convertScaleAbs(output, output, 255 / (max - min));
-    cv::applyColorMap(output, output, cv::COLORMAP_JET);
-    return output;
-}
+/*
+ * Maps a CV_32FC3 normal map to colors, each component from [-1, 1] to [0, 255]; pixels without normal (z = 0) are
+ * white. The rows are converted in parallel; the storage of output is reused if it already has the right dimensions.
+ */
+void color_normal(const cv::Mat& normal_map, cv::Mat& output);
+cv::Mat color_normal(const cv::Mat& normal_map);
+
+/*
+ * Computes a CV_32FC3 normal map of a CV_32FC1 depth map in millimeters, from the cross product of the vectors to
+ * the right and lower neighbor, oriented towards the camera. Pixels without depth or without valid neighbors get a
+ * zero normal. The storage of normal_map is reused if it already has the right dimensions.
+ */
+void compute_normal_map(const cv::Mat& depth_map, const kinectfusion::CameraParameters& cam_params,
+                        cv::Mat& normal_map);
+
+/*
+ * Maps a CV_16UC1 or CV_32FC1 depth map to colors with the JET colormap, from min_depth (blue) to max_depth (red);
+ * values outside the range are clamped. Normalization and colormap lookup are done in a single pass, and the
+ * storage of output is reused if it already has the right dimensions. With a fixed range (e.g. 0 to the depth
+ * cutoff distance), colors are stable across frames.
+ */
+void color_depth(const cv::Mat& depth_map, float min_depth, float max_depth, cv::Mat& output);
+
+// Maps the range of the depth map itself, which costs an additional pass to find it
+cv::Mat color_depth(const cv::Mat& depth_map);
 
 #endif //KINECTFUSION_UTIL_H
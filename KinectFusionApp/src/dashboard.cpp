@@ -0,0 +1,113 @@
+#include <dashboard.h>
+#include <util.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/imgproc.hpp>
+#pragma GCC diagnostic pop
+
+namespace {
+    constexpr int overlay_lines = 3;
+    constexpr int line_height = 18;
+    constexpr double font_scale = 0.45;
+
+    void draw_label(cv::Mat& panel, const char* label)
+    {
+        cv::putText(panel, label, cv::Point { 6, 16 }, cv::FONT_HERSHEY_SIMPLEX, font_scale,
+                    cv::Scalar { 255, 255, 255 }, 1, cv::LINE_AA);
+    }
+}
+
+Dashboard::Dashboard(const CameraParameters& cam_params, const double scale, const float _max_depth) :
+        panel_params(cam_params), max_depth{_max_depth},
+        panel_size{std::max(static_cast<int>(cam_params.image_width * scale), 1),
+                   std::max(static_cast<int>(cam_params.image_height * scale), 1)},
+        canvas{2 * panel_size.height + overlay_lines * line_height + 6, 2 * panel_size.width, CV_8UC3,
+               cv::Scalar { 0, 0, 0 }},
+        depth_panel{canvas(cv::Rect { 0, 0, panel_size.width, panel_size.height })},
+        normal_panel{canvas(cv::Rect { panel_size.width, 0, panel_size.width, panel_size.height })},
+        color_panel{canvas(cv::Rect { 0, panel_size.height, panel_size.width, panel_size.height })},
+        model_panel{canvas(cv::Rect { panel_size.width, panel_size.height, panel_size.width, panel_size.height })},
+        overlay{canvas(cv::Rect { 0, 2 * panel_size.height, canvas.cols, canvas.rows - 2 * panel_size.height })},
+        normal_map{panel_size, CV_32FC3}, status{}
+{
+    // Intrinsics of the downscaled depth panel, for computing its normals
+    const float scale_x = static_cast<float>(panel_size.width) / static_cast<float>(cam_params.image_width);
+    const float scale_y = static_cast<float>(panel_size.height) / static_cast<float>(cam_params.image_height);
+    panel_params.image_width = panel_size.width;
+    panel_params.image_height = panel_size.height;
+    panel_params.focal_x *= scale_x;
+    panel_params.focal_y *= scale_y;
+    panel_params.principal_x *= scale_x;
+    panel_params.principal_y *= scale_y;
+}
+
+cv::Size Dashboard::get_panel_size() const
+{
+    return panel_size;
+}
+
+void Dashboard::update(const DisplayFrame& frame)
+{
+    if (frame.depth_map.size() == panel_size) {
+        color_depth(frame.depth_map, 0.f, max_depth, depth_panel);
+        compute_normal_map(frame.depth_map, panel_params, normal_map);
+        color_normal(normal_map, normal_panel);
+    }
+    // The cameras deliver BGR, like the canvas
+    if (frame.color_map.size() == panel_size)
+        frame.color_map.copyTo(color_panel);
+    else if (!frame.color_map.empty())
+        cv::resize(frame.color_map, color_panel, panel_size, 0, 0, cv::INTER_AREA);
+    else
+        color_panel.setTo(cv::Scalar { 0, 0, 0 });
+    if (frame.model_frame.size() == panel_size)
+        frame.model_frame.copyTo(model_panel);
+    else if (!frame.model_frame.empty())
+        cv::resize(frame.model_frame, model_panel, panel_size, 0, 0, cv::INTER_AREA);
+
+    draw_label(depth_panel, "Depth");
+    draw_label(normal_panel, "Normals");
+    draw_label(color_panel, "Color");
+    draw_label(model_panel, "Model");
+    draw_overlay();
+}
+
+void Dashboard::set_status(const double fps, const std::vector<StageStatistics>& stages)
+{
+    std::stringstream fps_line {};
+    fps_line << std::fixed << std::setprecision(1) << fps << " fps";
+
+    // Latencies of the stages that determine the frame rate, as p50 / p99 in milliseconds
+    std::stringstream stage_lines[2] {};
+    size_t shown = 0;
+    for (const auto& stage : stages) {
+        if (stage.name == "main_loop" || stage.name.find("export") == 0)
+            continue;
+        auto& line = stage_lines[shown++ % 2];
+        line << std::fixed << std::setprecision(1) << stage.name << " " << stage.p50_ms << "/" << stage.p99_ms
+             << "ms   ";
+    }
+
+    status = { fps_line.str(), stage_lines[0].str(), stage_lines[1].str() };
+}
+
+const cv::Mat& Dashboard::get_canvas() const
+{
+    return canvas;
+}
+
+void Dashboard::draw_overlay()
+{
+    overlay.setTo(cv::Scalar { 32, 32, 32 });
+    for (size_t line = 0; line < status.size() && line < overlay_lines; ++line) {
+        cv::putText(overlay, status[line], cv::Point { 6, static_cast<int>(line + 1) * line_height },
+                    cv::FONT_HERSHEY_SIMPLEX, font_scale, cv::Scalar { 255, 255, 255 }, 1, cv::LINE_AA);
+    }
+}
@@ -1,9 +1,20 @@
 
 #include <depth_camera.h>
+#include <depth_codec.h>
+#include <export.h>
+#include <frame_conversion.h>
+#include <frame_prefetcher.h>
+#include <profiling.h>
 
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <vector>
+
+#include <algorithm>
+#include <cmath>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wall"
@@ -13,12 +24,397 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv/cv.hpp>
+#include <Eigen/Geometry>
 
 #pragma GCC diagnostic pop
 
+namespace {
+    // Measured in the threads doing the work, i.e. the capture thread or the prefetching workers
+    const size_t decode_stage = Profiler::register_stage("decode_frame");
+
+    // Frames held by the caller of grab_frame() unless set_held_frames() is called: one processed, one being grabbed
+    const size_t default_held_frames = 2;
+}
+
+// ### Base ###
+DepthCamera::DepthCamera(const size_t _internal_frames, const bool _color_enabled) :
+        frame_pool{_internal_frames + default_held_frames}, internal_frames{_internal_frames},
+        color_enabled{_color_enabled}
+{
+}
+
+void DepthCamera::set_held_frames(const size_t held_frames)
+{
+    frame_pool.reserve(internal_frames + held_frames);
+}
+
+void DepthCamera::print_statistics(std::ostream& stream) const
+{
+    if (frame_pool.get_hits() + frame_pool.get_misses() > 0)
+        stream << "Frame pool: " << frame_pool.get_hits() << " hits, "
+               << frame_pool.get_misses() << " misses" << std::endl;
+}
+
+bool DepthCamera::end_of_stream() const
+{
+    return false;
+}
+
+bool DepthCamera::get_ground_truth(const size_t /*frame_number*/, Eigen::Matrix4f& /*pose*/) const
+{
+    return false;
+}
+
+const FramePool& DepthCamera::get_frame_pool() const
+{
+    return frame_pool;
+}
+
+bool DepthCamera::is_color_enabled() const
+{
+    return color_enabled;
+}
+
+// ### Recorded ###
+RecordedCamera::RecordedCamera(const size_t _prefetch_frames, const size_t _decode_threads, const bool enable_color) :
+        // Frames in the ring and being decoded
+        DepthCamera{_prefetch_frames + _decode_threads, enable_color},
+        range{}, position{0},
+        prefetch_frames{_prefetch_frames}, decode_threads{_decode_threads}, prefetch_origin{0}, prefetcher{}
+{
+}
+
+RecordedCamera::~RecordedCamera() = default;
+
+InputFrame RecordedCamera::grab_frame() const
+{
+    const size_t index = advance();
+    if (!is_prefetching()) {
+        InputFrame frame {};
+        ScopedTimer timer { decode_stage };
+        decode_frame(index, frame);
+        return frame;
+    }
+
+    if (!prefetcher) {
+        prefetch_origin = index;
+        prefetcher = std::make_unique<FramePrefetcher>(
+                prefetch_frames, decode_threads, [this](const size_t sequence_number, InputFrame& slot) {
+                    // Frames past the end of the range are never handed out
+                    const size_t frame_index = index_after(prefetch_origin, sequence_number);
+                    if (frame_index < range_end()) {
+                        ScopedTimer timer { decode_stage };
+                        decode_frame(frame_index, slot);
+                    }
+                });
+    }
+    return prefetcher->next();
+}
+
+uint64_t RecordedCamera::get_timestamp_ns(const size_t /*index*/) const
+{
+    return 0;
+}
+
+bool RecordedCamera::get_ground_truth_pose(const size_t /*index*/, Eigen::Matrix4f& /*pose*/) const
+{
+    return false;
+}
+
+bool RecordedCamera::get_ground_truth(const size_t frame_number, Eigen::Matrix4f& pose) const
+{
+    const size_t index = index_after(range.start, frame_number);
+    return index < range_end() && get_ground_truth_pose(index, pose);
+}
+
+void RecordedCamera::set_range(const FrameRange& _range)
+{
+    if (_range.stride == 0)
+        throw std::invalid_argument{"The frame stride has to be at least 1"};
+    if (_range.start >= std::min(_range.end, frame_count()))
+        throw std::invalid_argument{"The frame range does not contain any frames"};
+
+    // Seeking first stops any background work of the previous range
+    seek(_range.start);
+    range = _range;
+}
+
+const FrameRange& RecordedCamera::get_range() const
+{
+    return range;
+}
+
+void RecordedCamera::seek(const size_t index)
+{
+    if (index >= frame_count())
+        throw std::out_of_range{"Frame index exceeds the recording"};
+
+    // Frames decoded ahead of time are of no use anymore
+    stop_prefetching();
+    position = index;
+}
+
+size_t RecordedCamera::get_position() const
+{
+    return position;
+}
+
+bool RecordedCamera::end_of_stream() const
+{
+    return position >= range_end();
+}
+
+size_t RecordedCamera::advance() const
+{
+    if (end_of_stream())
+        throw std::out_of_range{"The end of the recording has been reached"};
+
+    const size_t index = position;
+    position = index_after(index, 1);
+    return index;
+}
+
+size_t RecordedCamera::index_after(const size_t index, const size_t steps) const
+{
+    const size_t end = range_end();
+    if (!range.loop || index >= end)
+        return index + steps * range.stride;
+
+    // Steps until the range is left, after which the replay starts over at range.start
+    const size_t steps_to_end = (end - index + range.stride - 1) / range.stride;
+    if (steps < steps_to_end)
+        return index + steps * range.stride;
+    const size_t cycle_length = (end - range.start + range.stride - 1) / range.stride;
+    return range.start + (steps - steps_to_end) % cycle_length * range.stride;
+}
+
+void RecordedCamera::print_statistics(std::ostream& stream) const
+{
+    DepthCamera::print_statistics(stream);
+    if (prefetcher)
+        prefetcher->print_statistics(stream);
+}
+
+bool RecordedCamera::is_prefetching() const
+{
+    return prefetch_frames > 0;
+}
+
+void RecordedCamera::stop_prefetching() const
+{
+    prefetcher.reset();
+}
+
+size_t RecordedCamera::range_end() const
+{
+    return std::min(range.end, frame_count());
+}
+
+// ### Image sequences ###
+namespace {
+    std::string sequence_file_name(const std::string& data_path, const char* prefix, const size_t index,
+                                   const std::string& extension = ".png")
+    {
+        std::stringstream file_name;
+        file_name << data_path << prefix << std::setfill('0') << std::setw(5) << index << extension;
+        return file_name.str();
+    }
+
+    // Reads a whole file into the given buffer, reusing its storage. Returns false if the file could not be read.
+    bool read_file(const std::string& file_name, std::vector<uchar>& buffer)
+    {
+        std::ifstream file { file_name, std::ios::binary | std::ios::ate };
+        if (!file.is_open())
+            return false;
+
+        const auto size = file.tellg();
+        buffer.resize(static_cast<size_t>(size));
+        file.seekg(0);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(buffer.data()), size)) && !buffer.empty();
+    }
+
+    // Throws if the file could not be written completely, e.g. because the disk is full
+    void write_file(const std::string& file_name, const std::vector<uchar>& buffer)
+    {
+        std::ofstream file { file_name, std::ios::binary };
+        file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        file.close();
+        if (!file)
+            throw std::runtime_error{file_name + " could not be written"};
+    }
+
+    bool file_exists(const std::string& file_name)
+    {
+        struct stat file_stat {};
+        return stat(file_name.c_str(), &file_stat) == 0;
+    }
+
+    uint64_t to_nanoseconds(const double seconds)
+    {
+        return static_cast<uint64_t>(std::llround(seconds * 1e9));
+    }
+
+    // Lines of "timestamp value..." in the TUM RGB-D formats, sorted by timestamp; lines starting with # are comments
+    std::vector<std::pair<double, std::string>> read_timestamped_lines(const std::string& file_name)
+    {
+        std::ifstream file { file_name };
+        if (!file.is_open())
+            throw std::runtime_error{file_name + " could not be read"};
+
+        std::vector<std::pair<double, std::string>> lines {};
+        std::string line {};
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::stringstream line_stream { line };
+            double timestamp;
+            if (!(line_stream >> timestamp))
+                continue;
+            std::string value {};
+            std::getline(line_stream >> std::ws, value);
+            lines.emplace_back(timestamp, value);
+        }
+        std::sort(lines.begin(), lines.end(),
+                  [](const std::pair<double, std::string>& a, const std::pair<double, std::string>& b) {
+                      return a.first < b.first;
+                  });
+        return lines;
+    }
+
+    // Index of the line whose timestamp is closest to the given one, or -1 if none is within max_difference
+    long find_closest(const std::vector<std::pair<double, std::string>>& lines, const double timestamp,
+                      const double max_difference)
+    {
+        const auto next = std::lower_bound(lines.begin(), lines.end(), timestamp,
+                                           [](const std::pair<double, std::string>& line, const double value) {
+                                               return line.first < value;
+                                           });
+        const long next_index = next - lines.begin();
+
+        long closest = -1;
+        double closest_difference = max_difference;
+        for (const long candidate : { next_index - 1, next_index }) {
+            if (candidate < 0 || candidate >= static_cast<long>(lines.size()))
+                continue;
+            const double difference = std::abs(lines[static_cast<size_t>(candidate)].first - timestamp);
+            if (difference <= closest_difference) {
+                closest = candidate;
+                closest_difference = difference;
+            }
+        }
+        return closest;
+    }
+
+    // "tx ty tz qx qy qz qw" (in meters) into a camera-to-world transformation in millimeters
+    Eigen::Matrix4f parse_tum_pose(const std::string& values)
+    {
+        float tx, ty, tz, qx, qy, qz, qw;
+        if (!(std::stringstream { values } >> tx >> ty >> tz >> qx >> qy >> qz >> qw))
+            throw std::runtime_error{"Invalid ground truth pose: " + values};
+
+        Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+        pose.block<3, 3>(0, 0) = Eigen::Quaternionf { qw, qx, qy, qz }.normalized().toRotationMatrix();
+        pose.block<3, 1>(0, 3) = Eigen::Vector3f { tx, ty, tz } * 1000.f;
+        return pose;
+    }
+
+    // First file in the given directory whose name ends with suffix; empty if there is none
+    std::string find_file_with_suffix(const std::string& directory, const std::string& suffix)
+    {
+        std::string result {};
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr)
+            return result;
+        while (const dirent* entry = readdir(dir)) {
+            const std::string name { entry->d_name };
+            if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                result = directory + name;
+                break;
+            }
+        }
+        closedir(dir);
+        return result;
+    }
+}
+
+SequenceCamera::SequenceCamera(const size_t prefetch_frames, const size_t decode_threads, const bool enable_color) :
+        RecordedCamera{prefetch_frames, decode_threads, enable_color}, cam_params{}, depth_scale{1.f}, frames{}
+{
+}
+
+SequenceCamera::~SequenceCamera()
+{
+    stop_prefetching();
+}
+
+CameraParameters SequenceCamera::get_parameters() const
+{
+    return cam_params;
+}
+
+size_t SequenceCamera::frame_count() const
+{
+    return frames.size();
+}
+
+uint64_t SequenceCamera::get_timestamp_ns(const size_t index) const
+{
+    return frames.at(index).timestamp_ns;
+}
+
+bool SequenceCamera::get_ground_truth_pose(const size_t index, Eigen::Matrix4f& pose) const
+{
+    const auto& frame = frames.at(index);
+    if (frame.has_ground_truth)
+        pose = frame.ground_truth_pose;
+    return frame.has_ground_truth;
+}
+
+void SequenceCamera::decode_frame(const size_t index, InputFrame& frame) const
+{
+    // Scratch buffer, reused across frames by each decoding thread
+    thread_local std::vector<uchar> file_buffer {};
+
+    const SequenceFrame& files = frames[index];
+    const bool has_color = color_enabled && !files.color_file.empty();
+    const cv::Size frame_size { cam_params.image_width, cam_params.image_height };
+    frame = frame_pool.acquire(frame_size, has_color ? frame_size : cv::Size {});
+
+    if (!read_file(files.depth_file, file_buffer))
+        throw std::runtime_error{"Depth frame " + files.depth_file + " could not be read"};
+
+    // Decoding into existing buffers avoids reallocating them for every frame
+    const auto& depth_file = files.depth_file;
+    if (depth_file.size() > 4 && depth_file.compare(depth_file.size() - 4, 4, ".rvl") == 0) {
+        rvl_decode(file_buffer.data(), file_buffer.size(), frame.depth_map);
+    } else {
+        cv::imdecode(file_buffer, cv::IMREAD_ANYDEPTH, &frame.depth_map);
+        if (frame.depth_map.empty())
+            throw std::runtime_error{"Depth frame " + depth_file + " could not be decoded"};
+        if (frame.depth_map.type() != CV_16UC1)
+            throw std::runtime_error{"Depth frames have to be stored as 16 bit PNGs"};
+    }
+    // The pipeline is set up for the size of the camera parameters
+    if (frame.depth_map.size() != frame_size)
+        throw std::runtime_error{"Depth frame " + depth_file + " does not match the image size of the camera"};
+    frame.depth_scale = depth_scale;
+
+    if (has_color) {
+        if (!read_file(files.color_file, file_buffer))
+            throw std::runtime_error{"Color frame " + files.color_file + " could not be read"};
+        cv::imdecode(file_buffer, cv::IMREAD_COLOR, &frame.color_map);
+        if (frame.color_map.empty())
+            throw std::runtime_error{"Color frame " + files.color_file + " could not be decoded"};
+        if (frame.color_map.size() != frame_size)
+            throw std::runtime_error{"Color frame " + files.color_file +
+                                     " does not match the image size of the camera"};
+    }
+}
+
 // ### Pseudo ###
-PseudoCamera::PseudoCamera(const std::string& _data_path) :
-        data_path{_data_path}, cam_params{}, current_index{0}
+PseudoCamera::PseudoCamera(const std::string& data_path, const size_t prefetch_frames, const size_t decode_threads,
+                           const bool enable_color) :
+        SequenceCamera{prefetch_frames, decode_threads, enable_color}
 {
     std::ifstream cam_params_stream { data_path + "seq_cparam.txt" };
     if (!cam_params_stream.is_open())
@@ -26,43 +422,417 @@ PseudoCamera::PseudoCamera(const std::string& _data_path) :
     cam_params_stream >> cam_params.image_width >> cam_params.image_height;
     cam_params_stream >> cam_params.focal_x >> cam_params.focal_y;
     cam_params_stream >> cam_params.principal_x >> cam_params.principal_y;
-};
 
-InputFrame PseudoCamera::grab_frame () const
+    // Depth frames are either stored as 16 bit PNGs or RVL-compressed (see depth_codec.h)
+    const std::string depth_extension =
+            file_exists(sequence_file_name(data_path, "seq_depth", 0, ".rvl")) ? ".rvl" : ".png";
+
+    // The recording ends at the first missing depth frame
+    for (size_t index = 0;; ++index) {
+        SequenceFrame frame {};
+        frame.depth_file = sequence_file_name(data_path, "seq_depth", index, depth_extension);
+        frame.color_file = sequence_file_name(data_path, "seq_color", index);
+        if (!file_exists(frame.depth_file))
+            break;
+        if (!file_exists(frame.color_file))
+            frame.color_file.clear();
+        frames.push_back(std::move(frame));
+    }
+    if (frames.empty())
+        throw std::runtime_error{"Recording could not be read"};
+}
+
+// ### TUM RGB-D ###
+TumCamera::TumCamera(const std::string& data_path, const size_t prefetch_frames, const size_t decode_threads,
+                     const double max_time_difference, const bool enable_color) :
+        SequenceCamera{prefetch_frames, decode_threads, enable_color}
 {
-    std::stringstream depth_file;
-    depth_file << data_path << "seq_depth" << std::setfill('0') << std::setw(5) << current_index << ".png";
-    std::stringstream color_file;
-    color_file << data_path << "seq_color" << std::setfill('0') << std::setw(5) << current_index << ".png";
+    // Calibration of the three Kinects used for the dataset, see
+    // https://vision.in.tum.de/data/datasets/rgbd-dataset/file_formats#intrinsic_camera_calibration_of_the_kinect
+    cam_params.image_width = 640;
+    cam_params.image_height = 480;
+    if (data_path.find("freiburg1") != std::string::npos) {
+        cam_params.focal_x = 517.3f; cam_params.focal_y = 516.5f;
+        cam_params.principal_x = 318.6f; cam_params.principal_y = 255.3f;
+    } else if (data_path.find("freiburg2") != std::string::npos) {
+        cam_params.focal_x = 520.9f; cam_params.focal_y = 521.0f;
+        cam_params.principal_x = 325.1f; cam_params.principal_y = 249.7f;
+    } else if (data_path.find("freiburg3") != std::string::npos) {
+        cam_params.focal_x = 535.4f; cam_params.focal_y = 539.2f;
+        cam_params.principal_x = 320.1f; cam_params.principal_y = 247.6f;
+    } else {
+        cam_params.focal_x = 525.f; cam_params.focal_y = 525.f;
+        cam_params.principal_x = 319.5f; cam_params.principal_y = 239.5f;
+    }
 
-    InputFrame frame {};
-    cv::imread(depth_file.str(), -1).convertTo(frame.depth_map, CV_32FC1);
+    // Depth values are stored scaled by 5000, i.e. in units of 0.2mm
+    depth_scale = 0.2f;
+
+    // Each depth frame is associated with the color frame and the ground truth pose closest in time
+    const auto depth_lines = read_timestamped_lines(data_path + "depth.txt");
+    const auto color_lines = read_timestamped_lines(data_path + "rgb.txt");
+    const auto ground_truth_lines = file_exists(data_path + "groundtruth.txt") ?
+                                    read_timestamped_lines(data_path + "groundtruth.txt") :
+                                    std::vector<std::pair<double, std::string>> {};
+
+    for (const auto& depth_line : depth_lines) {
+        SequenceFrame frame {};
+        frame.depth_file = data_path + depth_line.second;
+        frame.timestamp_ns = to_nanoseconds(depth_line.first);
+
+        const long color_index = find_closest(color_lines, depth_line.first, max_time_difference);
+        if (color_index >= 0)
+            frame.color_file = data_path + color_lines[static_cast<size_t>(color_index)].second;
+
+        const long pose_index = find_closest(ground_truth_lines, depth_line.first, max_time_difference);
+        if (pose_index >= 0) {
+            frame.has_ground_truth = true;
+            frame.ground_truth_pose = parse_tum_pose(ground_truth_lines[static_cast<size_t>(pose_index)].second);
+        }
 
-    if (frame.depth_map.empty()) {  // When this happens, we reached the end of the recording and have to
-                                    // start at 0 again
-        current_index = 0;
-        depth_file = std::stringstream {};
-        color_file = std::stringstream {};
-        depth_file << data_path << "seq_depth" << std::setfill('0') << std::setw(5) << current_index << ".png";
-        color_file << data_path << "seq_color" << std::setfill('0') << std::setw(5) << current_index << ".png";
-        frame.depth_map = cv::imread(depth_file.str(), -1);
+        frames.push_back(std::move(frame));
     }
+    if (frames.empty())
+        throw std::runtime_error{"Dataset " + data_path + " does not contain any depth frames"};
+}
+
+// ### ICL-NUIM ###
+IclNuimCamera::IclNuimCamera(const std::string& data_path, const size_t prefetch_frames,
+                             const size_t decode_threads, const bool enable_color) :
+        SequenceCamera{prefetch_frames, decode_threads, enable_color}
+{
+    // The dataset specifies focal_y as -480; the TUM RGB-D compatible images are used with the positive value
+    cam_params.image_width = 640;
+    cam_params.image_height = 480;
+    cam_params.focal_x = 481.2f; cam_params.focal_y = 480.f;
+    cam_params.principal_x = 319.5f; cam_params.principal_y = 239.5f;
+
+    // Depth values are stored scaled by 5000, like in the TUM RGB-D dataset
+    depth_scale = 0.2f;
+
+    // The TUM RGB-D compatible version lists the frames in associations.txt as
+    // "timestamp depth_file timestamp color_file"; the ground truth is stored in <name>.gt.freiburg
+    std::ifstream associations { data_path + "associations.txt" };
+    if (!associations.is_open())
+        throw std::runtime_error{"Dataset " + data_path + " does not contain associations.txt"};
+
+    const std::string ground_truth_file = find_file_with_suffix(data_path, ".gt.freiburg");
+    const auto ground_truth_lines = ground_truth_file.empty() ?
+                                    std::vector<std::pair<double, std::string>> {} :
+                                    read_timestamped_lines(ground_truth_file);
+
+    std::string line {};
+    while (std::getline(associations, line)) {
+        double first_timestamp, second_timestamp;
+        std::string first_file {}, second_file {};
+        if (!(std::stringstream { line } >> first_timestamp >> first_file >> second_timestamp >> second_file))
+            continue;
+
+        // Some versions list the color frame first
+        if (first_file.find("depth") == std::string::npos)
+            std::swap(first_file, second_file);
+
+        SequenceFrame frame {};
+        frame.depth_file = data_path + first_file;
+        frame.color_file = data_path + second_file;
+        frame.timestamp_ns = to_nanoseconds(first_timestamp);
+
+        const long pose_index = find_closest(ground_truth_lines, first_timestamp, 1e-3);
+        if (pose_index >= 0) {
+            frame.has_ground_truth = true;
+            frame.ground_truth_pose = parse_tum_pose(ground_truth_lines[static_cast<size_t>(pose_index)].second);
+        }
+
+        frames.push_back(std::move(frame));
+    }
+    if (frames.empty())
+        throw std::runtime_error{"Dataset " + data_path + " does not contain any frames"};
+}
+
+// ### Kfrec recording ###
+KfrecCamera::KfrecCamera(const std::string& file_name, const bool enable_color) :
+        RecordedCamera{0, 1, enable_color}, reader{file_name}
+{
+    if (reader.frame_count() == 0)
+        throw std::runtime_error{"Recording does not contain any frames"};
+}
 
-    frame.color_map = cv::imread(color_file.str());
+InputFrame KfrecCamera::grab_frame() const
+{
+    InputFrame frame = RecordedCamera::grab_frame();
 
-    ++current_index;
+    // Let the kernel page in the next frame while this one is being processed
+    if (!end_of_stream())
+        reader.prefetch(get_position());
 
     return frame;
 }
 
-CameraParameters PseudoCamera::get_parameters() const
+void KfrecCamera::decode_frame(const size_t index, InputFrame& frame) const
+{
+    if (reader.get_depth_encoding() == KfrecDepthEncoding::Raw) {
+        frame.depth_map = reader.get_depth(index);
+    } else {
+        frame = frame_pool.acquire(cv::Size { reader.get_parameters().image_width,
+                                              reader.get_parameters().image_height }, cv::Size {});
+        reader.decode_depth(index, frame.depth_map);
+    }
+    if (color_enabled)
+        frame.color_map = reader.get_color(index);
+}
+
+CameraParameters KfrecCamera::get_parameters() const
+{
+    return reader.get_parameters();
+}
+
+size_t KfrecCamera::frame_count() const
+{
+    return reader.frame_count();
+}
+
+uint64_t KfrecCamera::get_timestamp_ns(const size_t index) const
+{
+    return reader.get_entry(index).timestamp_ns;
+}
+
+// ### Synthetic ###
+SyntheticCamera::SyntheticCamera(const SyntheticScene& _scene, const OrbitTrajectory& _trajectory,
+                                 const CameraParameters& _cam_params, const size_t _frame_count,
+                                 const SensorModel& _sensor, const size_t prefetch_frames, const size_t render_threads,
+                                 const bool enable_color) :
+        RecordedCamera{prefetch_frames, render_threads, enable_color},
+        scene{_scene}, trajectory{_trajectory}, cam_params{_cam_params}, total_frames{_frame_count}, sensor{_sensor}
+{
+    if (scene.empty())
+        throw std::invalid_argument{"The synthetic scene does not contain any objects"};
+    if (total_frames == 0)
+        throw std::invalid_argument{"The synthetic camera has to render at least one frame"};
+}
+
+SyntheticCamera::~SyntheticCamera()
+{
+    stop_prefetching();
+}
+
+CameraParameters SyntheticCamera::get_parameters() const
 {
     return cam_params;
 }
 
+size_t SyntheticCamera::frame_count() const
+{
+    return total_frames;
+}
+
+bool SyntheticCamera::get_ground_truth_pose(const size_t index, Eigen::Matrix4f& pose) const
+{
+    pose = trajectory.pose(index);
+    return true;
+}
+
+void SyntheticCamera::decode_frame(const size_t index, InputFrame& frame) const
+{
+    const cv::Size frame_size { cam_params.image_width, cam_params.image_height };
+    frame = frame_pool.acquire(frame_size, color_enabled ? frame_size : cv::Size {});
+    frame.depth_scale = 1.f;
+
+    // The prefetching threads already render several frames at once
+    scene.render(trajectory.pose(index), cam_params, sensor, index, frame.depth_map,
+                 color_enabled ? &frame.color_map : nullptr, !is_prefetching());
+}
+
+// ### Recording ###
+RecordingCamera::RecordingCamera(std::unique_ptr<DepthCamera> _camera, const std::string& _output_path,
+                                 const bool _compress_depth, const size_t queue_size, const OverflowPolicy policy) :
+        // Frames in the queue; the default held frames are the ones being written and copied, as the returned frames
+        // come from the recorded camera
+        DepthCamera{queue_size, _camera->is_color_enabled()},
+        camera{std::move(_camera)}, output_path{_output_path}, compress_depth{_compress_depth},
+        write_queue{queue_size, policy}, writer_thread{}, start_time{std::chrono::steady_clock::now()},
+        frames_written{0}, bytes_written{0}, write_time_ns{0}
+{
+    make_directories(output_path);
+
+    const auto cam_params = camera->get_parameters();
+    std::ofstream cam_params_stream { output_path + "seq_cparam.txt" };
+    if (!cam_params_stream.is_open())
+        throw std::runtime_error{"Camera parameters could not be written"};
+    cam_params_stream << cam_params.image_width << " " << cam_params.image_height << std::endl;
+    cam_params_stream << cam_params.focal_x << " " << cam_params.focal_y << std::endl;
+    cam_params_stream << cam_params.principal_x << " " << cam_params.principal_y << std::endl;
+    if (!cam_params_stream)
+        throw std::runtime_error{"Camera parameters could not be written"};
+
+    writer_thread = std::thread { &RecordingCamera::writer_loop, this };
+}
+
+RecordingCamera::~RecordingCamera()
+{
+    // Frames that are already queued are still written
+    write_queue.close();
+    writer_thread.join();
+}
+
+InputFrame RecordingCamera::grab_frame() const
+{
+    InputFrame frame = camera->grab_frame();
+
+    // The frame may point into buffers of the camera that are only valid until its next grab_frame()
+    InputFrame copy = frame_pool.acquire(frame.depth_map.size(), frame.color_map.size());
+    frame.depth_map.copyTo(copy.depth_map);
+    frame.color_map.copyTo(copy.color_map);
+    copy.depth_scale = frame.depth_scale;
+    write_queue.push(std::move(copy));
+
+    return frame;
+}
+
+CameraParameters RecordingCamera::get_parameters() const
+{
+    return camera->get_parameters();
+}
+
+bool RecordingCamera::end_of_stream() const
+{
+    return camera->end_of_stream();
+}
+
+bool RecordingCamera::get_ground_truth(const size_t frame_number, Eigen::Matrix4f& pose) const
+{
+    return camera->get_ground_truth(frame_number, pose);
+}
+
+void RecordingCamera::set_held_frames(const size_t held_frames)
+{
+    // The own pool only holds the copies for the writer thread
+    camera->set_held_frames(held_frames);
+}
+
+void RecordingCamera::print_statistics(std::ostream& stream) const
+{
+    camera->print_statistics(stream);
+    DepthCamera::print_statistics(stream);
+
+    const auto elapsed = std::chrono::duration<double> { std::chrono::steady_clock::now() - start_time }.count();
+    const auto write_time = static_cast<double>(write_time_ns) / 1e9;
+    const auto megabytes = static_cast<double>(bytes_written) / 1e6;
+    stream << "Recorded " << frames_written << " frames (" << megabytes << "MB) to " << output_path << ": "
+           << static_cast<double>(frames_written) / elapsed << " fps";
+    if (write_time > 0)
+        stream << ", writing at " << megabytes / write_time << "MB/s";
+    stream << ", dropped " << write_queue.get_dropped() << " frames, "
+           << write_queue.size() << " still queued" << std::endl;
+}
+
+void RecordingCamera::writer_loop()
+{
+    std::vector<uchar> encoded {};
+    const std::vector<int> png_parameters { cv::IMWRITE_PNG_COMPRESSION, 1 }; // Favor speed over size
+
+    InputFrame frame {};
+    try {
+        while (write_queue.pop(frame)) {
+            const auto write_start = std::chrono::steady_clock::now();
+            const size_t index = frames_written;
+            size_t frame_bytes = 0;
+
+            // Depth is stored in millimeters, which is what PseudoCamera expects
+            if (frame.depth_scale != 1.f)
+                frame.depth_map.convertTo(frame.depth_map, CV_16UC1, frame.depth_scale);
+
+            if (compress_depth)
+                rvl_encode(frame.depth_map, encoded);
+            else
+                cv::imencode(".png", frame.depth_map, encoded, png_parameters);
+            write_file(sequence_file_name(output_path, "seq_depth", index, compress_depth ? ".rvl" : ".png"), encoded);
+            frame_bytes += encoded.size();
+
+            if (!frame.color_map.empty()) {
+                cv::imencode(".png", frame.color_map, encoded, png_parameters);
+                write_file(sequence_file_name(output_path, "seq_color", index), encoded);
+                frame_bytes += encoded.size();
+            }
+
+            // Release the buffers, so they return to the pool
+            frame = InputFrame {};
+
+            bytes_written += frame_bytes;
+            write_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - write_start).count();
+            ++frames_written;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Recording stopped: " << e.what() << std::endl;
+        write_queue.close();
+    }
+}
+
+// ### Resampling ###
+ResampledCamera::ResampledCamera(std::unique_ptr<DepthCamera> _camera, const cv::Rect& _roi, const int _factor,
+                                 const DecimationFilter _filter) :
+        DepthCamera{0, _camera->is_color_enabled()},
+        camera{std::move(_camera)}, roi{_roi}, factor{_factor}, filter{_filter}, cam_params{}
+{
+    if (factor != 1 && factor != 2 && factor != 4)
+        throw std::invalid_argument{"The decimation factor has to be 1, 2 or 4"};
+
+    const auto source_params = camera->get_parameters();
+    const cv::Rect frame { 0, 0, source_params.image_width, source_params.image_height };
+    if (roi.area() == 0)
+        roi = frame;
+    if ((roi & frame) != roi || roi.width < factor || roi.height < factor)
+        throw std::invalid_argument{"The region of interest has to lie within the frame"};
+
+    // Only whole blocks are decimated
+    roi.width -= roi.width % factor;
+    roi.height -= roi.height % factor;
+
+    cam_params = resample_parameters(source_params, roi, factor, filter);
+}
+
+InputFrame ResampledCamera::grab_frame() const
+{
+    const InputFrame source = camera->grab_frame();
+
+    const cv::Size frame_size { cam_params.image_width, cam_params.image_height };
+    InputFrame frame = frame_pool.acquire(frame_size, source.color_map.empty() ? cv::Size {} : frame_size);
+
+    // Only the pixels within the region of interest are read
+    decimate_depth(source.depth_map(roi), factor, filter, frame.depth_map);
+    if (!source.color_map.empty())
+        decimate_color(source.color_map(roi), factor, frame.color_map);
+    frame.depth_scale = source.depth_scale;
+    frame.capture_time = source.capture_time;
+
+    return frame;
+}
+
+CameraParameters ResampledCamera::get_parameters() const
+{
+    return cam_params;
+}
+
+bool ResampledCamera::end_of_stream() const
+{
+    return camera->end_of_stream();
+}
+
+bool ResampledCamera::get_ground_truth(const size_t frame_number, Eigen::Matrix4f& pose) const
+{
+    // Cropping and decimating change the intrinsics only
+    return camera->get_ground_truth(frame_number, pose);
+}
+
+void ResampledCamera::print_statistics(std::ostream& stream) const
+{
+    camera->print_statistics(stream);
+    DepthCamera::print_statistics(stream);
+}
+
 // ### Asus Xtion PRO LIVE
-XtionCamera::XtionCamera() :
-        device{}, depthStream{}, colorStream{}, depthFrame{},
+XtionCamera::XtionCamera(const bool enable_color) :
+        DepthCamera{0, enable_color}, device{}, depthStream{}, colorStream{}, depthFrame{},
         colorFrame{}, cam_params{}
 {
     openni::OpenNI::initialize();
@@ -87,40 +857,12 @@ XtionCamera::XtionCamera() :
     depthMode.setFps(30);
     depthMode.setPixelFormat(openni::PIXEL_FORMAT_DEPTH_1_MM);
 
-    openni::VideoMode colorMode;
-    colorMode.setResolution(640, 480);
-    colorMode.setFps(30);
-    colorMode.setPixelFormat(openni::PIXEL_FORMAT_RGB888);
-
     depthStream.create(device, openni::SENSOR_DEPTH);
     depthStream.setVideoMode(depthMode);
     depthStream.start();
 
-    colorStream.create(device, openni::SENSOR_COLOR);
-    colorStream.setVideoMode(colorMode);
-
-    openni::CameraSettings *cameraSettings = colorStream.getCameraSettings();
-    cameraSettings->setAutoExposureEnabled(true);
-    cameraSettings->setAutoWhiteBalanceEnabled(true);
-    cameraSettings = colorStream.getCameraSettings();
-
-
-    if (cameraSettings != nullptr) {
-        std::cout << "Camera Settings" << std::endl;
-        std::cout << " Auto Exposure Enabled      : " << cameraSettings->getAutoExposureEnabled() << std::endl;
-        std::cout << " Auto WhiteBalance Enabled  : " << cameraSettings->getAutoWhiteBalanceEnabled() << std::endl;
-        std::cout << " Exposure                   : " << cameraSettings->getExposure() << std::endl;
-        std::cout << " Gain                       : " << cameraSettings->getGain() << std::endl;
-    }
-
-    colorStream.start();
-
-    if (device.setDepthColorSyncEnabled(true) != openni::STATUS_OK) {
-        std::cout << "setDepthColorSyncEnabled is disabled" << std::endl;
-    }
-    if (device.setImageRegistrationMode(openni::IMAGE_REGISTRATION_DEPTH_TO_COLOR) != openni::STATUS_OK) {
-        std::cout << "setImageRegistrationMode is disabled" << std::endl;
-    }
+    if (color_enabled)
+        start_color_stream();
 
     double pixelSize;
     depthStream.getProperty<double>(XN_STREAM_PROPERTY_ZERO_PLANE_PIXEL_SIZE, &pixelSize);
@@ -149,31 +891,71 @@ XtionCamera::XtionCamera() :
     cam_params = cp;
 }
 
+void XtionCamera::start_color_stream()
+{
+    openni::VideoMode colorMode;
+    colorMode.setResolution(640, 480);
+    colorMode.setFps(30);
+    colorMode.setPixelFormat(openni::PIXEL_FORMAT_RGB888);
+
+    colorStream.create(device, openni::SENSOR_COLOR);
+    colorStream.setVideoMode(colorMode);
+
+    openni::CameraSettings *cameraSettings = colorStream.getCameraSettings();
+    cameraSettings->setAutoExposureEnabled(true);
+    cameraSettings->setAutoWhiteBalanceEnabled(true);
+    cameraSettings = colorStream.getCameraSettings();
+
+
+    if (cameraSettings != nullptr) {
+        std::cout << "Camera Settings" << std::endl;
+        std::cout << " Auto Exposure Enabled      : " << cameraSettings->getAutoExposureEnabled() << std::endl;
+        std::cout << " Auto WhiteBalance Enabled  : " << cameraSettings->getAutoWhiteBalanceEnabled() << std::endl;
+        std::cout << " Exposure                   : " << cameraSettings->getExposure() << std::endl;
+        std::cout << " Gain                       : " << cameraSettings->getGain() << std::endl;
+    }
+
+    colorStream.start();
+
+    if (device.setDepthColorSyncEnabled(true) != openni::STATUS_OK) {
+        std::cout << "setDepthColorSyncEnabled is disabled" << std::endl;
+    }
+    if (device.setImageRegistrationMode(openni::IMAGE_REGISTRATION_DEPTH_TO_COLOR) != openni::STATUS_OK) {
+        std::cout << "setImageRegistrationMode is disabled" << std::endl;
+    }
+}
+
 InputFrame XtionCamera::grab_frame() const
 {
     depthStream.readFrame(&depthFrame);
-    colorStream.readFrame(&colorFrame);
+    if (color_enabled)
+        colorStream.readFrame(&colorFrame);
 
     if (!depthFrame.isValid() || depthFrame.getData() == nullptr ||
-        !colorFrame.isValid() || colorFrame.getData() == nullptr) {
+        (color_enabled && (!colorFrame.isValid() || colorFrame.getData() == nullptr))) {
         throw std::runtime_error{"Frame data retrieval error"};
     } else {
         cv::Mat depthImg16U { depthStream.getVideoMode().getResolutionY(),
                               depthStream.getVideoMode().getResolutionX(),
                               CV_16U,
                               static_cast<char*>(const_cast<void*>(depthFrame.getData())) };
-        cv::Mat depth_image;
-        depthImg16U.convertTo(depth_image, CV_32FC1);
-        cv::flip(depth_image, depth_image, 1);
-
-        cv::Mat color_image { colorStream.getVideoMode().getResolutionY(),
-                              colorStream.getVideoMode().getResolutionX(),
-                              CV_8UC3,
-                              static_cast<char*>(const_cast<void*>(colorFrame.getData())) };
-        cv::cvtColor(color_image, color_image, cv::COLOR_BGR2RGB);
-        cv::flip(color_image, color_image, 1);
-
-        return InputFrame { depth_image, color_image };
+        cv::Mat color_image {};
+        if (color_enabled)
+            color_image = cv::Mat { colorStream.getVideoMode().getResolutionY(),
+                                    colorStream.getVideoMode().getResolutionX(),
+                                    CV_8UC3,
+                                    static_cast<char*>(const_cast<void*>(colorFrame.getData())) };
+
+        // Mirroring and swapping the channels is done in one pass, directly from the OpenNI buffers
+        InputFrame frame = frame_pool.acquire(depthImg16U.size(), color_image.size());
+        mirror_depth(depthImg16U, frame.depth_map);
+        if (color_enabled)
+            mirror_swap_channels(color_image, frame.color_map);
+
+        // PIXEL_FORMAT_DEPTH_1_MM already delivers millimeters
+        frame.depth_scale = 1.f;
+
+        return frame;
     }
 }
 
@@ -183,13 +965,19 @@ CameraParameters XtionCamera::get_parameters() const
 }
 
 // ### Intel RealSense
-RealSenseCamera::RealSenseCamera() : pipeline{}
+RealSenseCamera::RealSenseCamera(const size_t capture_queue_size, const OverflowPolicy capture_policy,
+                                 const bool enable_color) :
+        // Frames in the capture queue and being copied
+        DepthCamera{capture_queue_size + 1, enable_color}, pipeline{}, cam_params{}, depth_scale{},
+        capture_queue{}, capture_policy{}, stop_capture{false}, capture_thread{}, capture_error{},
+        skipped_count{0}, latency_count{0}, latency_sum{0}, latency_max{0}
 {
     // Explicitly enable depth and color stream, with these constraints:
     // Same dimensions and color stream has format BGR 8bit
     rs2::config configuration {};
     configuration.disable_all_streams();
-    configuration.enable_stream(RS2_STREAM_COLOR, 1280, 720, RS2_FORMAT_BGR8, 30);
+    if (color_enabled)
+        configuration.enable_stream(RS2_STREAM_COLOR, 1280, 720, RS2_FORMAT_BGR8, 30);
     configuration.enable_stream(RS2_STREAM_DEPTH, 1280, 720, RS2_FORMAT_Z16, 30);
 
     // Use the first detected device, if any
@@ -232,13 +1020,23 @@ RealSenseCamera::RealSenseCamera() : pipeline{}
 
     // Get depth scale which is used to convert the measurements into millimeters
     depth_scale = pipeline.get_active_profile().get_device().first<rs2::depth_sensor>().get_depth_scale();
+
+    start_capture(capture_queue_size, capture_policy);
 }
 
-RealSenseCamera::RealSenseCamera(const std::string& filename) : pipeline{}
+RealSenseCamera::RealSenseCamera(const std::string& filename, const size_t capture_queue_size,
+                                 const OverflowPolicy capture_policy, const bool enable_color) :
+        // Frames in the capture queue and being copied
+        DepthCamera{capture_queue_size + 1, enable_color}, pipeline{}, cam_params{}, depth_scale{},
+        capture_queue{}, capture_policy{}, stop_capture{false}, capture_thread{}, capture_error{},
+        skipped_count{0}, latency_count{0}, latency_sum{0}, latency_max{0}
 {
     rs2::config configuration {};
     configuration.disable_all_streams();
     configuration.enable_device_from_file(filename);
+    // Without any enabled stream, all recorded streams are played back
+    if (!color_enabled)
+        configuration.enable_stream(RS2_STREAM_DEPTH);
     pipeline.start(configuration);
 
     auto streams = pipeline.get_active_profile().get_streams();
@@ -256,13 +1054,91 @@ RealSenseCamera::RealSenseCamera(const std::string& filename) : pipeline{}
 
     // Get depth scale which is used to convert the measurements into millimeters
     depth_scale = pipeline.get_active_profile().get_device().first<rs2::depth_sensor>().get_depth_scale();
+
+    start_capture(capture_queue_size, capture_policy);
+}
+
+RealSenseCamera::~RealSenseCamera()
+{
+    if (capture_thread.joinable()) {
+        stop_capture = true;
+        capture_queue->close();
+        capture_thread.join();
+    }
 }
 
 InputFrame RealSenseCamera::grab_frame() const
 {
-    auto data = pipeline.wait_for_frames();
-    auto depth = data.get_depth_frame();
-    auto color = data.get_color_frame();
+    if (!capture_queue)
+        return copy_frames(pipeline.wait_for_frames());
+
+    InputFrame frame {};
+    if (!capture_queue->pop(frame)) // Only fails if the capture thread terminated
+        std::rethrow_exception(capture_error);
+
+    // Keeping the latest frames means handing out the newest one; the older ones are stale by now
+    if (capture_policy == OverflowPolicy::DropOldest) {
+        while (capture_queue->try_pop(frame))
+            ++skipped_count;
+    }
+
+    const auto latency = std::chrono::duration<double, std::milli> {
+            std::chrono::steady_clock::now() - frame.capture_time }.count();
+    ++latency_count;
+    latency_sum += latency;
+    latency_max = std::max(latency_max, latency);
+
+    return frame;
+}
+
+void RealSenseCamera::print_statistics(std::ostream& stream) const
+{
+    DepthCamera::print_statistics(stream);
+    if (capture_queue) {
+        stream << "Captured " << capture_queue->get_pushed() << " frames, dropped "
+               << capture_queue->get_dropped() << " in the capture queue";
+        if (capture_policy == OverflowPolicy::DropOldest)
+            stream << ", skipped " << skipped_count << " stale ones";
+        stream << std::endl;
+        if (latency_count > 0)
+            stream << "Capture to process latency: " << latency_sum / static_cast<double>(latency_count)
+                   << "ms average, " << latency_max << "ms maximum" << std::endl;
+    }
+}
+
+void RealSenseCamera::start_capture(const size_t capture_queue_size, const OverflowPolicy _capture_policy)
+{
+    if (capture_queue_size == 0)
+        return;
+
+    capture_policy = _capture_policy;
+    capture_queue = std::make_unique<BoundedQueue<InputFrame>>(capture_queue_size, capture_policy);
+    capture_thread = std::thread { &RealSenseCamera::capture_loop, this };
+}
+
+void RealSenseCamera::capture_loop()
+{
+    try {
+        while (!stop_capture) {
+            rs2::frameset frameset {};
+            // Wait with a timeout, so the loop notices when it should stop
+            if (!pipeline.try_wait_for_frames(&frameset, 100))
+                continue;
+
+            InputFrame frame = copy_frames(frameset);
+            frame.capture_time = std::chrono::steady_clock::now();
+
+            capture_queue->push(std::move(frame));
+        }
+    } catch (...) {
+        capture_error = std::current_exception();
+        capture_queue->close();
+    }
+}
+
+InputFrame RealSenseCamera::wrap_frames(const rs2::frameset& frameset) const
+{
+    auto depth = frameset.get_depth_frame();
 
     cv::Mat depth_image { cv::Size { cam_params.image_width,
                                      cam_params.image_height },
@@ -270,21 +1146,35 @@ InputFrame RealSenseCamera::grab_frame() const
                           const_cast<void*>(depth.get_data()),
                           cv::Mat::AUTO_STEP};
 
-    cv::Mat converted_depth_image;
-    depth_image.convertTo(converted_depth_image, CV_32FC1, depth_scale * 1000.f);
-
-    cv::Mat color_image { cv::Size { cam_params.image_width,
-                                     cam_params.image_height },
-                          CV_8UC3,
-                          const_cast<void*>(color.get_data()),
-                          cv::Mat::AUTO_STEP};
+    cv::Mat color_image {};
+    if (color_enabled) {
+        auto color = frameset.get_color_frame();
+        color_image = cv::Mat { cv::Size { cam_params.image_width,
+                                           cam_params.image_height },
+                                CV_8UC3,
+                                const_cast<void*>(color.get_data()),
+                                cv::Mat::AUTO_STEP};
+    }
 
     return InputFrame {
-            converted_depth_image,
-            color_image
+            depth_image,
+            color_image,
+            depth_scale * 1000.f
     };
 }
 
+InputFrame RealSenseCamera::copy_frames(const rs2::frameset& frameset) const
+{
+    // The librealsense buffers are recycled once the frameset is released (and have to be returned quickly), so
+    // the frame is copied into pooled buffers
+    const InputFrame device_frame = wrap_frames(frameset);
+    InputFrame frame = frame_pool.acquire(device_frame.depth_map.size(), device_frame.color_map.size());
+    device_frame.depth_map.copyTo(frame.depth_map);
+    device_frame.color_map.copyTo(frame.color_map);
+    frame.depth_scale = device_frame.depth_scale;
+    return frame;
+}
+
 CameraParameters RealSenseCamera::get_parameters() const
 {
     return cam_params;
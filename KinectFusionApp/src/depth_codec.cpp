@@ -0,0 +1,254 @@
+#include <depth_codec.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    // Rows per independently coded stripe; small enough to give all threads work, large enough to keep the
+    // per-stripe overhead negligible
+    constexpr uint32_t default_stripe_rows = 16;
+
+    // Packs nibbles into 32 bit words, first nibble in the most significant bits
+    class NibbleWriter {
+    public:
+        explicit NibbleWriter(std::vector<uchar>& _buffer) : buffer(_buffer), word{0}, nibble_count{0} {}
+
+        void write_vle(uint32_t value)
+        {
+            // 3 data bits per nibble, the fourth bit marks that more nibbles follow
+            do {
+                uint32_t nibble = value & 0x7;
+                value >>= 3;
+                if (value != 0)
+                    nibble |= 0x8;
+                write_nibble(nibble);
+            } while (value != 0);
+        }
+
+        void flush()
+        {
+            if (nibble_count > 0) {
+                word <<= 4 * (8 - nibble_count);
+                write_word();
+            }
+        }
+
+    private:
+        void write_nibble(const uint32_t nibble)
+        {
+            word = (word << 4) | nibble;
+            if (++nibble_count == 8)
+                write_word();
+        }
+
+        void write_word()
+        {
+            const auto position = buffer.size();
+            buffer.resize(position + sizeof(uint32_t));
+            std::memcpy(&buffer[position], &word, sizeof(uint32_t));
+            word = 0;
+            nibble_count = 0;
+        }
+
+        std::vector<uchar>& buffer;
+        uint32_t word;
+        int nibble_count;
+    };
+
+    class NibbleReader {
+    public:
+        NibbleReader(const uchar* _data, const uchar* _end) : data{_data}, end{_end}, word{0}, nibble_count{0} {}
+
+        uint32_t read_vle()
+        {
+            uint32_t value = 0;
+            for (int shift = 0;; shift += 3) {
+                // A uint32 takes at most 11 nibbles; checked before shifting, as shifting by 32 or more is undefined
+                if (shift > 30)
+                    throw std::runtime_error{"Invalid RVL data"};
+                if (nibble_count == 0)
+                    read_word();
+                const uint32_t nibble = word >> 28;
+                word <<= 4;
+                --nibble_count;
+
+                value |= (nibble & 0x7) << shift;
+                if ((nibble & 0x8) == 0)
+                    return value;
+            }
+        }
+
+    private:
+        void read_word()
+        {
+            if (end - data < static_cast<std::ptrdiff_t>(sizeof(uint32_t)))
+                throw std::runtime_error{"Truncated RVL data"};
+            std::memcpy(&word, data, sizeof(uint32_t));
+            data += sizeof(uint32_t);
+            nibble_count = 8;
+        }
+
+        const uchar* data;
+        const uchar* end;
+        uint32_t word;
+        int nibble_count;
+    };
+
+    void encode_stripe(const uint16_t* pixels, const size_t pixel_count, std::vector<uchar>& buffer)
+    {
+        NibbleWriter writer { buffer };
+        const uint16_t* const end = pixels + pixel_count;
+        int previous = 0;
+
+        while (pixels != end) {
+            const uint16_t* const zeros_end = std::find_if(pixels, end, [](const uint16_t value) { return value != 0; });
+            const uint16_t* const values_end = std::find(zeros_end, end, 0);
+            writer.write_vle(static_cast<uint32_t>(zeros_end - pixels));
+            writer.write_vle(static_cast<uint32_t>(values_end - zeros_end));
+
+            for (pixels = zeros_end; pixels != values_end; ++pixels) {
+                const int delta = *pixels - previous;
+                // Zigzag coding, so small magnitudes of both signs need few nibbles
+                writer.write_vle((static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+                previous = *pixels;
+            }
+        }
+
+        writer.flush();
+    }
+
+    void decode_stripe(const uchar* data, const uchar* data_end, uint16_t* pixels, const size_t pixel_count)
+    {
+        NibbleReader reader { data, data_end };
+        uint16_t* const end = pixels + pixel_count;
+        int previous = 0;
+
+        while (pixels != end) {
+            const uint32_t zeros = reader.read_vle();
+            const uint32_t values = reader.read_vle();
+            if (zeros + static_cast<size_t>(values) > static_cast<size_t>(end - pixels))
+                throw std::runtime_error{"Invalid RVL data"};
+
+            pixels = std::fill_n(pixels, zeros, uint16_t { 0 });
+            for (uint32_t value_idx = 0; value_idx < values; ++value_idx) {
+                const uint32_t zigzag = reader.read_vle();
+                previous += static_cast<int>(zigzag >> 1) ^ -static_cast<int>(zigzag & 1);
+                *pixels++ = static_cast<uint16_t>(previous);
+            }
+        }
+    }
+
+    // The offsets table may be unaligned within the encoded data
+    uint32_t read_offset(const uchar* offsets, const uint32_t index)
+    {
+        uint32_t offset;
+        std::memcpy(&offset, offsets + index * sizeof(uint32_t), sizeof(uint32_t));
+        return offset;
+    }
+
+    /*
+     * Exceptions must not leave cv::parallel_for_, so the first error of any stripe is stored in error and has to be
+     * rethrown by the caller afterwards
+     */
+    class StripeDecoder : public cv::ParallelLoopBody {
+    public:
+        StripeDecoder(const RvlHeader& _header, const uchar* _offsets, const uchar* _payload,
+                      cv::Mat_<uint16_t>& _depth_map, std::exception_ptr& _error, std::mutex& _error_mutex) :
+                header(_header), offsets{_offsets}, payload{_payload}, depth_map(_depth_map),
+                error(_error), error_mutex(_error_mutex) {}
+
+        void operator()(const cv::Range& range) const override
+        {
+            for (int stripe = range.start; stripe < range.end; ++stripe) {
+                const auto stripe_index = static_cast<uint32_t>(stripe);
+                const auto first_row = static_cast<int>(stripe_index * header.stripe_rows);
+                const auto rows = std::min<int>(static_cast<int>(header.stripe_rows), depth_map.rows - first_row);
+                try {
+                    decode_stripe(payload + read_offset(offsets, stripe_index),
+                                  payload + read_offset(offsets, stripe_index + 1),
+                                  depth_map.ptr<uint16_t>(first_row), static_cast<size_t>(rows * depth_map.cols));
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock { error_mutex };
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+        }
+
+    private:
+        const RvlHeader& header;
+        const uchar* offsets;
+        const uchar* payload;
+        cv::Mat_<uint16_t>& depth_map;
+        std::exception_ptr& error;
+        std::mutex& error_mutex;
+    };
+}
+
+void rvl_encode(const cv::Mat& depth_map, std::vector<uchar>& buffer)
+{
+    CV_Assert(depth_map.type() == CV_16UC1);
+
+    // Stripes are coded as one sequence of pixels, so they have to be contiguous
+    const cv::Mat pixels = depth_map.isContinuous() ? depth_map : depth_map.clone();
+
+    RvlHeader header {};
+    std::memcpy(header.magic, rvl_magic, sizeof(rvl_magic));
+    header.width = static_cast<uint32_t>(pixels.cols);
+    header.height = static_cast<uint32_t>(pixels.rows);
+    header.stripe_rows = default_stripe_rows;
+    header.stripe_count = (header.height + header.stripe_rows - 1) / header.stripe_rows;
+
+    const size_t offsets_position = sizeof(RvlHeader);
+    const size_t payload_position = offsets_position + (header.stripe_count + 1) * sizeof(uint32_t);
+    buffer.resize(payload_position);
+    std::memcpy(buffer.data(), &header, sizeof(RvlHeader));
+
+    std::vector<uint32_t> offsets(header.stripe_count + 1, 0);
+    for (uint32_t stripe = 0; stripe < header.stripe_count; ++stripe) {
+        const uint32_t first_row = stripe * header.stripe_rows;
+        const uint32_t rows = std::min(header.stripe_rows, header.height - first_row);
+        offsets[stripe] = static_cast<uint32_t>(buffer.size() - payload_position);
+        encode_stripe(pixels.ptr<uint16_t>(static_cast<int>(first_row)),
+                      static_cast<size_t>(rows) * header.width, buffer);
+    }
+    offsets[header.stripe_count] = static_cast<uint32_t>(buffer.size() - payload_position);
+
+    std::memcpy(&buffer[offsets_position], offsets.data(), offsets.size() * sizeof(uint32_t));
+}
+
+void rvl_decode(const uchar* data, const size_t size, cv::Mat_<uint16_t>& depth_map)
+{
+    RvlHeader header {};
+    if (size < sizeof(RvlHeader))
+        throw std::runtime_error{"Truncated RVL data"};
+    std::memcpy(&header, data, sizeof(RvlHeader));
+    if (std::memcmp(header.magic, rvl_magic, sizeof(rvl_magic)) != 0 || header.stripe_rows == 0 ||
+        header.stripe_count != (header.height + header.stripe_rows - 1) / header.stripe_rows)
+        throw std::runtime_error{"Invalid RVL data"};
+
+    const size_t payload_position = sizeof(RvlHeader) + (header.stripe_count + 1) * sizeof(uint32_t);
+    if (size < payload_position)
+        throw std::runtime_error{"Truncated RVL data"};
+
+    const uchar* offsets = data + sizeof(RvlHeader);
+    for (uint32_t stripe = 0; stripe < header.stripe_count; ++stripe)
+        if (read_offset(offsets, stripe) > read_offset(offsets, stripe + 1))
+            throw std::runtime_error{"Invalid RVL data"};
+    if (payload_position + read_offset(offsets, header.stripe_count) > size)
+        throw std::runtime_error{"Truncated RVL data"};
+
+    depth_map.create(static_cast<int>(header.height), static_cast<int>(header.width));
+    if (!depth_map.isContinuous())
+        depth_map = cv::Mat_<uint16_t>(static_cast<int>(header.height), static_cast<int>(header.width));
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    cv::parallel_for_(cv::Range { 0, static_cast<int>(header.stripe_count) },
+                      StripeDecoder { header, offsets, data + payload_position, depth_map, error, error_mutex });
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,69 @@
+#include <export.h>
+
+#include <cerrno>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+void export_poses(const std::vector<Eigen::Matrix4f>& poses, const std::vector<size_t>& frame_numbers,
+                  const std::string& directory, const std::string& prefix)
+{
+    if (frame_numbers.size() != poses.size())
+        throw std::invalid_argument{"Every pose needs a frame number"};
+
+    make_directories(directory);
+    std::ofstream frames_file { directory + prefix + "_frames.txt" };
+    for (size_t i = 0; i < poses.size(); ++i) {
+        std::stringstream file_name {};
+        file_name << directory << prefix << std::setfill('0') << std::setw(5) << i << ".txt";
+        std::ofstream { file_name.str() } << poses[i] << std::endl;
+        frames_file << frame_numbers[i] << "\n";
+    }
+}
+
+bool export_ground_truth_poses(const DepthCamera& camera, const std::vector<size_t>& frame_numbers,
+                               const std::string& directory)
+{
+    std::vector<Eigen::Matrix4f> poses {};
+    poses.reserve(frame_numbers.size());
+    bool has_ground_truth = false;
+    for (const size_t frame_number : frame_numbers) {
+        Eigen::Matrix4f pose;
+        if (camera.get_ground_truth(frame_number, pose))
+            has_ground_truth = true;
+        else
+            pose.setZero(); // No ground truth for this frame
+        poses.push_back(pose);
+    }
+    if (!has_ground_truth)
+        return false;
+
+    export_poses(poses, frame_numbers, directory, "seq_gt_pose");
+    return true;
+}
+
+void export_mesh(const kinectfusion::SurfaceMesh& mesh, const std::string& file_name)
+{
+    make_directories(file_name);
+    kinectfusion::export_ply(file_name, mesh);
+}
+
+void export_pointcloud(const kinectfusion::PointCloud& cloud, const std::string& file_name)
+{
+    make_directories(file_name);
+    kinectfusion::export_ply(file_name, cloud);
+}
+
+void make_directories(const std::string& path)
+{
+    for (size_t separator = path.find('/', 1); separator != std::string::npos;
+         separator = path.find('/', separator + 1)) {
+        const std::string directory = path.substr(0, separator);
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+            throw std::runtime_error{"Directory " + directory + " could not be created"};
+    }
+}
@@ -0,0 +1,163 @@
+#include <frame_conversion.h>
+
+#include <algorithm>
+
+// The SIMD kernels are compiled for their instruction set regardless of the build flags and chosen at runtime, so
+// generic builds use them, too
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KINECTFUSION_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+#if defined(KINECTFUSION_X86_SIMD)
+    // Both reverse the elements of a row block by block, starting at element x; return where the remainder starts
+    template <typename Element>
+    __attribute__((target("avx2")))
+    int reverse_blocks_avx2(const Element* source, Element* destination, const int length, int x)
+    {
+        // Reverse within both 128 bit lanes, then swap the lanes
+        const __m256i reverse_mask = sizeof(Element) == 1 ?
+                _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0) :
+                _mm256_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                                 14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+        constexpr int elements = 32 / sizeof(Element);
+        for (; x + elements <= length; x += elements) {
+            const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + length - x - elements));
+            const auto reversed = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(block, reverse_mask), 0x4E);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + x), reversed);
+        }
+        return x;
+    }
+
+    template <typename Element>
+    __attribute__((target("ssse3")))
+    int reverse_blocks_ssse3(const Element* source, Element* destination, const int length, int x)
+    {
+        const __m128i reverse_mask = sizeof(Element) == 1 ?
+                _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0) :
+                _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+        constexpr int elements = 16 / sizeof(Element);
+        for (; x + elements <= length; x += elements) {
+            const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + length - x - elements));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x), _mm_shuffle_epi8(block, reverse_mask));
+        }
+        return x;
+    }
+#endif
+
+    /*
+     * Writes the elements of a row in reverse order. Mirroring a row of 3 channel pixels while swapping the first
+     * and third channel is the same as reversing all of its bytes, so both conversions reduce to this.
+     * Element must be 1 or 2 bytes wide.
+     */
+    template <typename Element>
+    void reverse_row(const Element* source, Element* destination, const int length)
+    {
+        int x = 0;
+
+#if defined(KINECTFUSION_X86_SIMD)
+        static const bool has_avx2 = cv::checkHardwareSupport(CV_CPU_AVX2);
+        static const bool has_ssse3 = cv::checkHardwareSupport(CV_CPU_SSSE3);
+        if (has_avx2)
+            x = reverse_blocks_avx2(source, destination, length, x);
+        if (has_ssse3)
+            x = reverse_blocks_ssse3(source, destination, length, x);
+#endif
+
+        // Remainder of the row (or all of it without SIMD support)
+        std::reverse_copy(source, source + length - x, destination + x);
+    }
+}
+
+void convert_depth(const cv::Mat_<uint16_t>& raw_depth_map, const float depth_scale, cv::Mat_<float>& depth_map)
+{
+    raw_depth_map.convertTo(depth_map, CV_32FC1, depth_scale);
+}
+
+void mirror_depth(const cv::Mat& raw_depth_map, cv::Mat_<uint16_t>& depth_map)
+{
+    CV_Assert(raw_depth_map.type() == CV_16UC1);
+    depth_map.create(raw_depth_map.rows, raw_depth_map.cols);
+
+    for (int y = 0; y < raw_depth_map.rows; ++y)
+        reverse_row(raw_depth_map.ptr<uint16_t>(y), depth_map.ptr<uint16_t>(y), raw_depth_map.cols);
+}
+
+void mirror_swap_channels(const cv::Mat& raw_color_map, cv::Mat_<cv::Vec3b>& color_map)
+{
+    CV_Assert(raw_color_map.type() == CV_8UC3);
+    color_map.create(raw_color_map.rows, raw_color_map.cols);
+
+    for (int y = 0; y < raw_color_map.rows; ++y)
+        reverse_row(raw_color_map.ptr<uchar>(y), color_map.ptr<uchar>(y), raw_color_map.cols * 3);
+}
+
+void decimate_depth(const cv::Mat_<uint16_t>& depth_map, const int factor, const DecimationFilter filter,
+                    cv::Mat_<uint16_t>& decimated)
+{
+    CV_Assert(factor >= 1 && factor <= 4);
+    decimated.create(depth_map.rows / factor, depth_map.cols / factor);
+
+    const int center = (factor - 1) / 2;
+    for (int y = 0; y < decimated.rows; ++y) {
+        auto* destination = decimated.ptr<uint16_t>(y);
+        if (filter == DecimationFilter::Nearest) {
+            const auto* source = depth_map.ptr<uint16_t>(y * factor + center) + center;
+            for (int x = 0; x < decimated.cols; ++x)
+                destination[x] = source[x * factor];
+            continue;
+        }
+
+        for (int x = 0; x < decimated.cols; ++x) {
+            // Missing measurements would drag the median towards 0, so only valid values are considered
+            uint16_t values[16];
+            int count = 0;
+            for (int block_y = 0; block_y < factor; ++block_y) {
+                const auto* source = depth_map.ptr<uint16_t>(y * factor + block_y) + x * factor;
+                for (int block_x = 0; block_x < factor; ++block_x) {
+                    if (source[block_x] != 0)
+                        values[count++] = source[block_x];
+                }
+            }
+            if (count == 0) {
+                destination[x] = 0;
+                continue;
+            }
+            std::nth_element(values, values + count / 2, values + count);
+            destination[x] = values[count / 2];
+        }
+    }
+}
+
+void decimate_color(const cv::Mat_<cv::Vec3b>& color_map, const int factor, cv::Mat_<cv::Vec3b>& decimated)
+{
+    CV_Assert(factor >= 1);
+    decimated.create(color_map.rows / factor, color_map.cols / factor);
+
+    const int center = (factor - 1) / 2;
+    for (int y = 0; y < decimated.rows; ++y) {
+        const auto* source = color_map.ptr<cv::Vec3b>(y * factor + center) + center;
+        auto* destination = decimated.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < decimated.cols; ++x)
+            destination[x] = source[x * factor];
+    }
+}
+
+CameraParameters resample_parameters(const CameraParameters& cam_params, const cv::Rect& roi, const int factor,
+                                     const DecimationFilter filter)
+{
+    // Pixel x of the decimated image corresponds to factor * x + center in the cropped image
+    const float center = filter == DecimationFilter::Median ? static_cast<float>(factor - 1) / 2.f :
+                                                              static_cast<float>((factor - 1) / 2);
+
+    CameraParameters resampled = cam_params;
+    resampled.image_width = roi.width / factor;
+    resampled.image_height = roi.height / factor;
+    resampled.focal_x = cam_params.focal_x / static_cast<float>(factor);
+    resampled.focal_y = cam_params.focal_y / static_cast<float>(factor);
+    resampled.principal_x = (cam_params.principal_x - static_cast<float>(roi.x) - center) / static_cast<float>(factor);
+    resampled.principal_y = (cam_params.principal_y - static_cast<float>(roi.y) - center) / static_cast<float>(factor);
+    return resampled;
+}
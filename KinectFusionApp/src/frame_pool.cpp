@@ -0,0 +1,68 @@
+#include <frame_pool.h>
+#include <depth_camera.h>
+
+#include <algorithm>
+
+FramePool::FramePool(const size_t _capacity) :
+        capacity{_capacity}, buffers{}, mutex{}, hits{0}, misses{0}
+{
+    buffers.reserve(capacity);
+}
+
+void FramePool::reserve(const size_t _capacity)
+{
+    std::lock_guard<std::mutex> lock { mutex };
+    capacity = std::max(capacity, _capacity);
+    buffers.reserve(capacity);
+}
+
+InputFrame FramePool::acquire(const cv::Size depth_size, const cv::Size color_size)
+{
+    const bool has_color = color_size.area() > 0;
+
+    std::lock_guard<std::mutex> lock { mutex };
+
+    Buffers* reusable = nullptr;
+    for (auto& candidate : buffers) {
+        if (!is_unused(candidate.depth_map) || !is_unused(candidate.color_map))
+            continue;
+
+        if (candidate.depth_map.size() == depth_size &&
+            (has_color ? candidate.color_map.size() == color_size : candidate.color_map.empty())) {
+            ++hits;
+            return InputFrame { candidate.depth_map, candidate.color_map };
+        }
+        reusable = &candidate;
+    }
+
+    // Nothing matching is available, so we have to allocate. Either in place of an unused frame with other
+    // dimensions, as a new pool entry, or, if the pool is exhausted, without pooling it at all.
+    ++misses;
+    Buffers allocated {};
+    Buffers& target = reusable != nullptr ? *reusable :
+                      buffers.size() < capacity ? (buffers.emplace_back(), buffers.back()) : allocated;
+
+    target.depth_map.create(depth_size, CV_16UC1);
+    if (has_color)
+        target.color_map.create(color_size, CV_8UC3);
+    else
+        target.color_map.release();
+
+    return InputFrame { target.depth_map, target.color_map };
+}
+
+size_t FramePool::get_hits() const
+{
+    return hits;
+}
+
+size_t FramePool::get_misses() const
+{
+    return misses;
+}
+
+bool FramePool::is_unused(const cv::Mat& mat)
+{
+    // Only the pool itself is holding a reference
+    return mat.u == nullptr || __atomic_load_n(&mat.u->refcount, __ATOMIC_ACQUIRE) == 1;
+}
@@ -0,0 +1,105 @@
+#include <frame_prefetcher.h>
+#include <profiling.h>
+
+#include <algorithm>
+#include <iomanip>
+
+FramePrefetcher::FramePrefetcher(const size_t capacity, const size_t num_workers, DecodeFunction _decode) :
+        slots(std::max<size_t>(capacity, num_workers)), slot_ready(slots.size(), false),
+        slot_errors(slots.size()), decode{std::move(_decode)}, mutex{}, slot_decoded{}, slot_released{},
+        claimed_count{0}, decoded_count{0}, released_count{0}, holds_slot{false}, stop{false},
+        start_time{std::chrono::steady_clock::now()}, busy_time{}, workers{}
+{
+    for (size_t worker_idx = 0; worker_idx < std::max<size_t>(num_workers, 1); ++worker_idx)
+        workers.emplace_back(&FramePrefetcher::worker_loop, this);
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        stop = true;
+    }
+    slot_released.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+InputFrame FramePrefetcher::next()
+{
+    std::unique_lock<std::mutex> lock { mutex };
+
+    // The consumer is done with the frame it got the last time
+    if (holds_slot) {
+        // Dropping the ring's reference lets pooled buffers be recycled once the consumer drops its copy, too
+        slots[released_count % slots.size()] = InputFrame {};
+        slot_ready[released_count % slots.size()] = false;
+        ++released_count;
+        slot_released.notify_all();
+    }
+
+    slot_decoded.wait(lock, [this] { return decoded_count > released_count; });
+    holds_slot = true;
+
+    // The failed frame counts as handed out, so the following frames can still be retrieved
+    std::exception_ptr error {};
+    std::swap(error, slot_errors[released_count % slots.size()]);
+    if (error)
+        std::rethrow_exception(error);
+
+    return slots[released_count % slots.size()];
+}
+
+void FramePrefetcher::print_statistics(std::ostream& stream) const
+{
+    std::lock_guard<std::mutex> lock { mutex };
+
+    const auto elapsed = std::chrono::duration<double> { std::chrono::steady_clock::now() - start_time }.count();
+    const auto busy = std::chrono::duration<double> { busy_time }.count();
+    const auto frames = static_cast<double>(decoded_count);
+
+    stream << "Decoded " << decoded_count << " frames with " << workers.size() << " thread(s) in "
+           << std::fixed << std::setprecision(2) << elapsed << "s: " << frames / elapsed << " fps achieved";
+    if (decoded_count > 0)
+        stream << ", " << 1000.0 * busy / frames << "ms per frame, "
+               << 100.0 * busy / (elapsed * static_cast<double>(workers.size())) << "% worker utilization";
+    stream << std::endl;
+}
+
+void FramePrefetcher::worker_loop()
+{
+    Tracer::set_thread_name("prefetch");
+    for (;;) {
+        size_t sequence_number;
+        {
+            std::unique_lock<std::mutex> lock { mutex };
+            slot_released.wait(lock, [this] { return stop || claimed_count - released_count < slots.size(); });
+            if (stop)
+                return;
+            sequence_number = claimed_count++;
+        }
+
+        // The slot is exclusively owned by this worker until it is marked as ready
+        const auto decode_start = std::chrono::steady_clock::now();
+        std::exception_ptr error {};
+        try {
+            decode(sequence_number, slots[sequence_number % slots.size()]);
+        } catch (...) {
+            // Escaping the thread would terminate the application; the consumer gets it instead
+            error = std::current_exception();
+        }
+        const auto decode_time = std::chrono::steady_clock::now() - decode_start;
+
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            busy_time += decode_time;
+            slot_ready[sequence_number % slots.size()] = true;
+            slot_errors[sequence_number % slots.size()] = error;
+
+            // Frames finishing out of order are only handed out once all their predecessors are done
+            while (decoded_count < claimed_count && slot_ready[decoded_count % slots.size()])
+                ++decoded_count;
+        }
+        slot_decoded.notify_one();
+    }
+}
@@ -0,0 +1,263 @@
+#include <kfrec.h>
+#include <depth_codec.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ### Reader ###
+KfrecReader::KfrecReader(const std::string& file_name) :
+        data{nullptr}, size{0}, header{}, entries{nullptr}
+{
+    const int file_descriptor = open(file_name.c_str(), O_RDONLY);
+    if (file_descriptor < 0)
+        throw std::runtime_error{"Recording " + file_name + " could not be opened"};
+
+    struct stat file_stat {};
+    if (fstat(file_descriptor, &file_stat) != 0) {
+        close(file_descriptor);
+        throw std::runtime_error{"Recording " + file_name + " could not be opened"};
+    }
+    size = static_cast<size_t>(file_stat.st_size);
+
+    void* mapping = size >= sizeof(KfrecHeader) ?
+                    mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0) : MAP_FAILED;
+    close(file_descriptor); // The mapping stays valid after closing the file
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error{"Recording " + file_name + " could not be mapped"};
+    data = static_cast<const unsigned char*>(mapping);
+
+    std::memcpy(&header, data, sizeof(KfrecHeader));
+    if (!is_valid()) {
+        munmap(const_cast<unsigned char*>(data), size);
+        throw std::runtime_error{"Recording " + file_name + " is not a valid .kfrec file"};
+    }
+
+    // Frames are usually read front to back
+    madvise(const_cast<unsigned char*>(data), size, MADV_SEQUENTIAL);
+}
+
+namespace {
+    // Whether length bytes starting at offset lie within a file of the given size, without overflowing
+    bool is_within(const uint64_t offset, const uint64_t length, const uint64_t size)
+    {
+        return offset <= size && length <= size - offset;
+    }
+}
+
+bool KfrecReader::is_valid()
+{
+    if (std::memcmp(header.magic, kfrec_magic, sizeof(kfrec_magic)) != 0 || header.version != kfrec_version ||
+        header.depth_encoding > static_cast<uint32_t>(KfrecDepthEncoding::Rvl) ||
+        header.image_width <= 0 || header.image_height <= 0)
+        return false;
+
+    // The entries are accessed in place
+    if (header.index_offset % alignof(KfrecFrameEntry) != 0 || !is_within(header.index_offset, 0, size) ||
+        header.frame_count > (size - header.index_offset) / sizeof(KfrecFrameEntry))
+        return false;
+    entries = reinterpret_cast<const KfrecFrameEntry*>(data + header.index_offset);
+
+    // Every payload is checked once here, so frames can be accessed without any further checks
+    const auto pixels = static_cast<uint64_t>(header.image_width) * static_cast<uint64_t>(header.image_height);
+    for (size_t index = 0; index < header.frame_count; ++index) {
+        const KfrecFrameEntry& entry = entries[index];
+        if (!is_within(entry.depth_offset, entry.depth_size, size) ||
+            (entry.color_size != 0 && (entry.color_size != pixels * 3 ||
+                                       !is_within(entry.color_offset, entry.color_size, size))))
+            return false;
+
+        if (get_depth_encoding() == KfrecDepthEncoding::Raw) {
+            if (entry.depth_size != pixels * sizeof(uint16_t) || entry.depth_offset % alignof(uint16_t) != 0)
+                return false;
+        } else {
+            // The decoded depth map has to match the camera parameters
+            RvlHeader rvl_header {};
+            if (entry.depth_size < sizeof(RvlHeader))
+                return false;
+            std::memcpy(&rvl_header, data + entry.depth_offset, sizeof(RvlHeader));
+            if (rvl_header.width != static_cast<uint32_t>(header.image_width) ||
+                rvl_header.height != static_cast<uint32_t>(header.image_height))
+                return false;
+        }
+    }
+    return true;
+}
+
+KfrecReader::~KfrecReader()
+{
+    munmap(const_cast<unsigned char*>(data), size);
+}
+
+size_t KfrecReader::frame_count() const
+{
+    return header.frame_count;
+}
+
+CameraParameters KfrecReader::get_parameters() const
+{
+    CameraParameters cam_params {};
+    cam_params.image_width = header.image_width;
+    cam_params.image_height = header.image_height;
+    cam_params.focal_x = header.focal_x;
+    cam_params.focal_y = header.focal_y;
+    cam_params.principal_x = header.principal_x;
+    cam_params.principal_y = header.principal_y;
+    return cam_params;
+}
+
+KfrecDepthEncoding KfrecReader::get_depth_encoding() const
+{
+    return static_cast<KfrecDepthEncoding>(header.depth_encoding);
+}
+
+const KfrecFrameEntry& KfrecReader::get_entry(const size_t index) const
+{
+    if (index >= header.frame_count)
+        throw std::out_of_range{"Frame index exceeds the recording"};
+    return entries[index];
+}
+
+cv::Mat KfrecReader::get_depth(const size_t index) const
+{
+    if (get_depth_encoding() != KfrecDepthEncoding::Raw)
+        throw std::logic_error{"Compressed depth has to be decoded"};
+
+    const auto& entry = get_entry(index);
+    return cv::Mat { header.image_height, header.image_width, CV_16UC1,
+                     const_cast<unsigned char*>(data + entry.depth_offset) };
+}
+
+cv::Mat KfrecReader::get_color(const size_t index) const
+{
+    const auto& entry = get_entry(index);
+    if (entry.color_size == 0)
+        return cv::Mat {};
+    return cv::Mat { header.image_height, header.image_width, CV_8UC3,
+                     const_cast<unsigned char*>(data + entry.color_offset) };
+}
+
+void KfrecReader::decode_depth(const size_t index, cv::Mat_<uint16_t>& depth_map) const
+{
+    if (get_depth_encoding() == KfrecDepthEncoding::Raw) {
+        get_depth(index).copyTo(depth_map);
+    } else {
+        const auto& entry = get_entry(index);
+        rvl_decode(data + entry.depth_offset, entry.depth_size, depth_map);
+    }
+}
+
+void KfrecReader::prefetch(const size_t index) const
+{
+    const auto& entry = get_entry(index);
+    const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    // The color payload directly follows the depth payload
+    const uint64_t begin = entry.depth_offset / page_size * page_size;
+    const uint64_t end = (entry.color_size > 0 ? entry.color_offset + entry.color_size :
+                                                 entry.depth_offset + entry.depth_size);
+    madvise(const_cast<unsigned char*>(data + begin), end - begin, MADV_WILLNEED);
+}
+
+// ### Writer ###
+KfrecWriter::KfrecWriter(const std::string& file_name, const CameraParameters& camera_parameters,
+                         const KfrecDepthEncoding depth_encoding) :
+        file{file_name, std::ios::binary | std::ios::trunc}, header{}, entries{}, encoded_depth{}, finished{false}
+{
+    if (!file.is_open())
+        throw std::runtime_error{"Recording " + file_name + " could not be created"};
+
+    std::memcpy(header.magic, kfrec_magic, sizeof(kfrec_magic));
+    header.version = kfrec_version;
+    header.depth_encoding = static_cast<uint32_t>(depth_encoding);
+    header.image_width = camera_parameters.image_width;
+    header.image_height = camera_parameters.image_height;
+    header.focal_x = camera_parameters.focal_x;
+    header.focal_y = camera_parameters.focal_y;
+    header.principal_x = camera_parameters.principal_x;
+    header.principal_y = camera_parameters.principal_y;
+
+    // Placeholder, the final header is written by finish()
+    file.write(reinterpret_cast<const char*>(&header), sizeof(KfrecHeader));
+}
+
+KfrecWriter::~KfrecWriter()
+{
+    // Throwing here would terminate the application if the writer is destroyed while unwinding; errors are only
+    // reported by calling finish() explicitly
+    if (!finished) {
+        try {
+            finish();
+        } catch (const std::exception&) {
+        }
+    }
+}
+
+void KfrecWriter::write_frame(const cv::Mat& depth_map, const cv::Mat& color_map, const uint64_t timestamp_ns)
+{
+    if (depth_map.type() != CV_16UC1 ||
+        depth_map.cols != header.image_width || depth_map.rows != header.image_height)
+        throw std::invalid_argument{"Depth map does not match the recording"};
+    if (!color_map.empty() && (color_map.type() != CV_8UC3 ||
+        color_map.cols != header.image_width || color_map.rows != header.image_height))
+        throw std::invalid_argument{"Color map does not match the recording"};
+
+    KfrecFrameEntry entry {};
+    if (header.depth_encoding == static_cast<uint32_t>(KfrecDepthEncoding::Raw)) {
+        entry.depth_offset = write_payload(depth_map);
+        entry.depth_size = depth_map.total() * depth_map.elemSize();
+    } else {
+        rvl_encode(depth_map, encoded_depth);
+        entry.depth_offset = write_payload(encoded_depth.data(), encoded_depth.size(), 1, encoded_depth.size());
+        entry.depth_size = encoded_depth.size();
+    }
+    if (!color_map.empty()) {
+        entry.color_offset = write_payload(color_map);
+        entry.color_size = color_map.total() * color_map.elemSize();
+    }
+    entry.timestamp_ns = timestamp_ns;
+
+    entries.push_back(entry);
+}
+
+void KfrecWriter::finish()
+{
+    // Align the index table, so the reader can access the entries in place
+    write_payload(cv::Mat {});
+    header.index_offset = static_cast<uint64_t>(file.tellp());
+    header.frame_count = entries.size();
+    file.write(reinterpret_cast<const char*>(entries.data()),
+               static_cast<std::streamsize>(entries.size() * sizeof(KfrecFrameEntry)));
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(KfrecHeader));
+    file.close();
+    finished = true;
+}
+
+uint64_t KfrecWriter::write_payload(const unsigned char* payload, const size_t row_size, const int rows,
+                                    const size_t step)
+{
+    static const char padding[kfrec_alignment] {};
+    const auto position = static_cast<uint64_t>(file.tellp());
+    const auto offset = (position + kfrec_alignment - 1) / kfrec_alignment * kfrec_alignment;
+    file.write(padding, static_cast<std::streamsize>(offset - position));
+
+    // Rows of non-continuous matrices (e.g. views into larger images) are written one after another
+    for (int y = 0; y < rows; ++y)
+        file.write(reinterpret_cast<const char*>(payload + y * step), static_cast<std::streamsize>(row_size));
+
+    if (!file)
+        throw std::runtime_error{"Recording could not be written"};
+
+    return offset;
+}
+
+uint64_t KfrecWriter::write_payload(const cv::Mat& image)
+{
+    return write_payload(image.data, image.cols * image.elemSize(), image.rows, image.step);
+}
@@ -1,17 +1,31 @@
 
 #include <kinectfusion.h>
+#include <dashboard.h>
 #include <depth_camera.h>
+#include <export.h>
+#include <frame_conversion.h>
+#include <profiling.h>
 #include <util.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <memory>
+#include <sstream>
+#include <thread>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wall"
 #pragma GCC diagnostic ignored "-Wextra"
 #pragma GCC diagnostic ignored "-Weffc++"
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
 #pragma GCC diagnostic pop
 
 #include <cxxopts.hpp>
@@ -20,6 +34,92 @@
 std::string data_path {};
 std::string recording_name {};
 
+// Instrumented stages of the main loop
+const size_t grab_stage = Profiler::register_stage("grab_frame");
+const size_t capture_wait_stage = Profiler::register_stage("capture_queue_wait");
+const size_t convert_stage = Profiler::register_stage("convert_depth");
+const size_t process_stage = Profiler::register_stage("process_frame");
+const size_t model_frame_stage = Profiler::register_stage("model_frame");
+const size_t imshow_stage = Profiler::register_stage("imshow");
+const size_t export_extract_stage = Profiler::register_stage("export_extract");
+const size_t export_write_stage = Profiler::register_stage("export_write");
+const size_t main_loop_stage = Profiler::register_stage("main_loop");   // Whole run, for comparing replays
+
+// Counters of the trace
+const size_t capture_queue_counter = Profiler::register_stage("capture_queue");
+const size_t export_queue_counter = Profiler::register_stage("export_queue");
+const size_t frame_counter = Profiler::register_stage("frame");
+
+// Set by SIGINT; stops capturing like a key press does
+std::atomic<bool> interrupted { false };
+
+// Results that are written when the application ends
+enum ExportFlags : unsigned {
+    ExportNone = 0,
+    ExportPoses = 1 << 0,
+    ExportMesh = 1 << 1,
+    ExportCloud = 1 << 2,
+    ExportAll = ExportPoses | ExportMesh | ExportCloud
+};
+
+/*
+ * Which model frames are fetched from the pipeline and shown. Frames are skipped if they are not every_nth frame,
+ * if they would exceed max_fps or if the previous one has not been shown yet.
+ */
+struct VisualizationPolicy {
+    double max_fps;     // 0 for no limit
+    size_t every_nth;
+    double scale;       // Size of the preview relative to the model frame, in (0, 1]
+    bool dashboard;     // Show input depth, normals and color next to the model frame, with the stage latencies
+};
+
+struct RunOptions {
+    size_t capture_queue_size;
+    OverflowPolicy capture_policy;  // Block keeps every frame; DropOldest (with a queue of 1) the latest frame only
+    int cuda_device;
+    bool headless;          // No window; the application stops at the end of the stream or on SIGINT
+    unsigned exports;       // ExportFlags used unless a key selects others
+    size_t max_frames;      // Capturing stops after this many frames; 0 for no limit
+    size_t export_every;    // Exports are also written after every export_every frames; 0 for only at the end
+    std::string output_dir; // Ends with '/'
+    std::string stats_json; // Files to write the stage latencies to, if not empty
+    std::string stats_csv;
+    VisualizationPolicy visualization;
+};
+
+// Parses a comma separated list of "poses", "mesh", "cloud", "all" and "none"
+unsigned parse_exports(const std::string& list)
+{
+    unsigned exports = ExportNone;
+    std::istringstream stream { list };
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item == "poses")
+            exports |= ExportPoses;
+        else if (item == "mesh")
+            exports |= ExportMesh;
+        else if (item == "cloud")
+            exports |= ExportCloud;
+        else if (item == "all")
+            exports |= ExportAll;
+        else if (item != "none" && !item.empty())
+            throw std::invalid_argument("Unknown export \"" + item + "\"");
+    }
+    return exports;
+}
+
+// Exports selected by a key: 'a' saves all, 'p' the poses, 'm' the mesh, ' ' nothing; -1 for other keys
+int key_exports(const int key)
+{
+    switch (key) {
+        case 'a': return ExportAll;
+        case 'p': return ExportPoses;
+        case 'm': return ExportMesh;
+        case ' ': return ExportNone;
+        default: return -1;
+    }
+}
+
 auto make_configuration(const std::shared_ptr<cpptoml::table>& toml_config)
 {
     kinectfusion::GlobalConfiguration configuration;
@@ -48,104 +148,525 @@ auto make_configuration(const std::shared_ptr<cpptoml::table>& toml_config)
     return configuration;
 }
 
-auto make_camera(const std::shared_ptr<cpptoml::table>& toml_config)
+FrameRange make_frame_range(const std::shared_ptr<cpptoml::table>& toml_config)
+{
+    FrameRange range {};
+    range.start = static_cast<size_t>(std::max(
+            toml_config->get_qualified_as<int>("camera.start_frame").value_or(0), 0));
+    const auto end_frame = toml_config->get_qualified_as<int>("camera.end_frame").value_or(-1);
+    if (end_frame >= 0)
+        range.end = static_cast<size_t>(end_frame);
+    range.stride = static_cast<size_t>(std::max(
+            toml_config->get_qualified_as<int>("camera.frame_stride").value_or(1), 1));
+    range.loop = toml_config->get_qualified_as<bool>("camera.loop").value_or(false);
+    return range;
+}
+
+Eigen::Vector3f get_vector(const std::shared_ptr<cpptoml::table>& table, const std::string& key,
+                           const Eigen::Vector3f& default_value)
+{
+    // cpptoml does not convert between integer and floating point arrays
+    auto values = table->get_array_of<double>(key);
+    if (!values) {
+        if (const auto integer_values = table->get_array_of<int64_t>(key))
+            values = std::vector<double> { integer_values->begin(), integer_values->end() };
+        else
+            return default_value;
+    }
+    if (values->size() != 3)
+        throw std::invalid_argument(key + " has to have three elements");
+    return Eigen::Vector3f { static_cast<float>((*values)[0]), static_cast<float>((*values)[1]),
+                             static_cast<float>((*values)[2]) };
+}
+
+std::unique_ptr<SyntheticCamera> make_synthetic_camera(const std::shared_ptr<cpptoml::table>& toml_config,
+                                                       const bool enable_color)
+{
+    const auto settings = toml_config->get_table_qualified("camera.synthetic");
+    if (!settings)
+        throw std::invalid_argument("The synthetic camera needs a [camera.synthetic] section");
+
+    CameraParameters cam_params {};
+    cam_params.image_width = settings->get_as<int>("width").value_or(640);
+    cam_params.image_height = settings->get_as<int>("height").value_or(480);
+    const auto intrinsics = settings->get_array_of<double>("intrinsics")
+            .value_or(std::vector<double> { 525.0, 525.0, 319.5, 239.5 });
+    if (intrinsics.size() != 4)
+        throw std::invalid_argument("camera.synthetic.intrinsics has to be [ fx, fy, cx, cy ]");
+    cam_params.focal_x = static_cast<float>(intrinsics[0]);
+    cam_params.focal_y = static_cast<float>(intrinsics[1]);
+    cam_params.principal_x = static_cast<float>(intrinsics[2]);
+    cam_params.principal_y = static_cast<float>(intrinsics[3]);
+
+    OrbitTrajectory trajectory {};
+    trajectory.center = get_vector(settings, "orbit_center", trajectory.center);
+    trajectory.radius = static_cast<float>(settings->get_as<double>("orbit_radius").value_or(trajectory.radius));
+    trajectory.height = static_cast<float>(settings->get_as<double>("orbit_height").value_or(trajectory.height));
+    trajectory.degrees_per_frame = static_cast<float>(
+            settings->get_as<double>("degrees_per_frame").value_or(trajectory.degrees_per_frame));
+
+    SensorModel sensor {};
+    sensor.max_depth = static_cast<float>(settings->get_as<double>("max_depth").value_or(sensor.max_depth));
+    sensor.noise_stddev = static_cast<float>(settings->get_as<double>("noise_stddev").value_or(sensor.noise_stddev));
+    sensor.seed = static_cast<uint32_t>(settings->get_as<int64_t>("seed").value_or(sensor.seed));
+
+    SyntheticScene scene {};
+    if (const auto objects = settings->get_table_array("objects")) {
+        for (const auto& object : *objects) {
+            SdfPrimitive primitive {};
+            const auto type = object->get_as<std::string>("type").value_or("");
+            const Eigen::Vector3f color = get_vector(object, "color", { 200.f, 200.f, 200.f });
+            primitive.color = cv::Vec3b { static_cast<uchar>(color.z()), static_cast<uchar>(color.y()),
+                                          static_cast<uchar>(color.x()) };
+            primitive.position = get_vector(object, "position", Eigen::Vector3f::Zero());
+            if (type == "sphere") {
+                primitive.type = SdfPrimitive::Type::Sphere;
+                primitive.size.x() = static_cast<float>(object->get_as<double>("radius").value_or(100.0));
+            } else if (type == "box") {
+                primitive.type = SdfPrimitive::Type::Box;
+                primitive.size = get_vector(object, "size", { 200.f, 200.f, 200.f }) / 2.f;
+            } else if (type == "plane") {
+                primitive.type = SdfPrimitive::Type::Plane;
+                primitive.size = get_vector(object, "normal", { 0.f, -1.f, 0.f }).normalized();
+            } else {
+                throw std::invalid_argument("Synthetic objects have to be of type \"sphere\", \"box\" or \"plane\"");
+            }
+            scene.add(primitive);
+        }
+    } else {
+        scene = SyntheticScene::make_default();
+    }
+
+    return std::make_unique<SyntheticCamera>(
+            scene, trajectory, cam_params,
+            static_cast<size_t>(std::max(settings->get_as<int>("frames").value_or(360), 1)), sensor,
+            static_cast<size_t>(std::max(settings->get_as<int>("prefetch_frames").value_or(0), 0)),
+            static_cast<size_t>(std::max(settings->get_as<int>("render_threads").value_or(1), 1)), enable_color);
+}
+
+// camera.color is either true, false or "auto", which only acquires color if the pipeline output is shown or
+// colored results are exported. The exports selected by keys are covered, as keys are only read if the output is shown.
+bool is_color_needed(const std::shared_ptr<cpptoml::table>& toml_config, const bool use_output_frame,
+                     const unsigned exports)
+{
+    if (const auto color = toml_config->get_qualified_as<bool>("camera.color"))
+        return *color;
+    const auto color = toml_config->get_qualified_as<std::string>("camera.color").value_or("auto");
+    if (color != "auto")
+        throw std::invalid_argument("camera.color has to be true, false or \"auto\"");
+    // The model's colors, and thus those of meshes and point clouds, are integrated from the color frames
+    return use_output_frame || (exports & (ExportMesh | ExportCloud)) != 0;
+}
+
+auto make_camera(const std::shared_ptr<cpptoml::table>& toml_config, const bool use_output_frame,
+                 const unsigned exports)
 {
     std::unique_ptr<DepthCamera> camera;
 
+    const bool enable_color = is_color_needed(toml_config, use_output_frame, exports);
+
     const auto camera_type = *toml_config->get_qualified_as<std::string>("camera.type");
-    if (camera_type == "Pseudo") {
+    if (camera_type == "Pseudo" || camera_type == "TUM" || camera_type == "ICL-NUIM") {
         std::stringstream source_path {};
         source_path << data_path << "source/" << recording_name << "/";
-        camera = std::make_unique<PseudoCamera>(source_path.str());
+        const auto prefetch_frames = static_cast<size_t>(std::max(
+                toml_config->get_qualified_as<int>("camera.pseudo.prefetch_frames").value_or(0), 0));
+        const auto decode_threads = static_cast<size_t>(std::max(
+                toml_config->get_qualified_as<int>("camera.pseudo.decode_threads").value_or(1), 1));
+
+        std::unique_ptr<SequenceCamera> sequence_camera;
+        if (camera_type == "Pseudo") {
+            sequence_camera = std::make_unique<PseudoCamera>(source_path.str(), prefetch_frames, decode_threads,
+                                                             enable_color);
+        } else if (camera_type == "TUM") {
+            const auto max_time_difference =
+                    toml_config->get_qualified_as<double>("camera.tum.max_time_difference").value_or(0.02);
+            sequence_camera = std::make_unique<TumCamera>(source_path.str(), prefetch_frames, decode_threads,
+                                                          max_time_difference, enable_color);
+        } else {
+            sequence_camera = std::make_unique<IclNuimCamera>(source_path.str(), prefetch_frames, decode_threads,
+                                                              enable_color);
+        }
+        sequence_camera->set_range(make_frame_range(toml_config));
+        camera = std::move(sequence_camera);
+    } else if (camera_type == "Recording") {
+        std::stringstream source_file {};
+        source_file << data_path << "source/" << recording_name << ".kfrec";
+        auto kfrec_camera = std::make_unique<KfrecCamera>(source_file.str(), enable_color);
+        kfrec_camera->set_range(make_frame_range(toml_config));
+        camera = std::move(kfrec_camera);
+    } else if (camera_type == "Synthetic") {
+        auto synthetic_camera = make_synthetic_camera(toml_config, enable_color);
+        synthetic_camera->set_range(make_frame_range(toml_config));
+        camera = std::move(synthetic_camera);
     } else if (camera_type == "Xtion") {
-        camera = std::make_unique<XtionCamera>();
+        camera = std::make_unique<XtionCamera>(enable_color);
     } else if (camera_type == "RealSense") {
+        const auto capture_queue_size = static_cast<size_t>(std::max(
+                toml_config->get_qualified_as<int>("camera.realsense.capture_queue_size").value_or(0), 0));
+        const auto capture_policy =
+                toml_config->get_qualified_as<std::string>("camera.realsense.capture_policy").value_or("latest");
+        if (capture_policy != "latest" && capture_policy != "all")
+            throw std::invalid_argument("camera.realsense.capture_policy has to be either \"latest\" or \"all\"");
+        const auto overflow_policy = capture_policy == "latest" ? OverflowPolicy::DropOldest : OverflowPolicy::Block;
+
         if(*toml_config->get_qualified_as<bool>("camera.realsense.live")) {
-            camera = std::make_unique<RealSenseCamera>();
+            camera = std::make_unique<RealSenseCamera>(capture_queue_size, overflow_policy, enable_color);
         } else {
             std::stringstream source_file {};
             source_file << data_path << "source/" << recording_name << ".bag";
-            camera = std::make_unique<RealSenseCamera>(source_file.str());
+            camera = std::make_unique<RealSenseCamera>(source_file.str(), capture_queue_size, overflow_policy,
+                                                       enable_color);
         }
     } else {
         throw std::logic_error("There is no implementation for the camera type you specified.");
     }
 
+    if (toml_config->get_qualified_as<bool>("camera.record.enabled").value_or(false)) {
+        std::stringstream output_path {};
+        output_path << data_path << "source/"
+                    << toml_config->get_qualified_as<std::string>("camera.record.name").value_or(recording_name + "_recorded")
+                    << "/";
+        const auto queue_size = static_cast<size_t>(std::max(
+                toml_config->get_qualified_as<int>("camera.record.queue_size").value_or(32), 1));
+        const auto policy = toml_config->get_qualified_as<std::string>("camera.record.policy").value_or("drop");
+        if (policy != "drop" && policy != "block")
+            throw std::invalid_argument("camera.record.policy has to be either \"drop\" or \"block\"");
+        const auto compress_depth = toml_config->get_qualified_as<bool>("camera.record.rvl").value_or(false);
+
+        camera = std::make_unique<RecordingCamera>(std::move(camera), output_path.str(), compress_depth, queue_size,
+                                                   policy == "drop" ? OverflowPolicy::DropNewest : OverflowPolicy::Block);
+    }
+
+    // Resampling comes after recording, so the original frames are recorded
+    const auto roi_values = toml_config->get_qualified_array_of<int64_t>("camera.resample.roi")
+            .value_or(std::vector<int64_t> {});
+    const auto decimation = toml_config->get_qualified_as<int>("camera.resample.decimation").value_or(1);
+    if (!roi_values.empty() || decimation != 1) {
+        if (!roi_values.empty() && roi_values.size() != 4)
+            throw std::invalid_argument("camera.resample.roi has to be [ x, y, width, height ]");
+        const cv::Rect roi = roi_values.empty() ? cv::Rect {} :
+                             cv::Rect { static_cast<int>(roi_values[0]), static_cast<int>(roi_values[1]),
+                                        static_cast<int>(roi_values[2]), static_cast<int>(roi_values[3]) };
+
+        const auto filter = toml_config->get_qualified_as<std::string>("camera.resample.filter").value_or("median");
+        if (filter != "median" && filter != "nearest")
+            throw std::invalid_argument("camera.resample.filter has to be either \"median\" or \"nearest\"");
+
+        camera = std::make_unique<ResampledCamera>(std::move(camera), roi, decimation,
+                                                   filter == "median" ? DecimationFilter::Median :
+                                                                        DecimationFilter::Nearest);
+    }
+
     return camera;
 }
 
-void main_loop(const std::unique_ptr<DepthCamera> camera, const kinectfusion::GlobalConfiguration& configuration)
+template <typename T>
+void print_queue_statistics(std::ostream& stream, const std::string& name, const BoundedQueue<T>& queue)
+{
+    stream << name << " queue: " << queue.get_pushed() << " pushed, " << queue.get_dropped() << " dropped, depth "
+           << queue.get_average_size() << " on average and " << queue.get_max_size() << " at most (capacity "
+           << queue.capacity() << ")" << std::endl;
+}
+
+/*
+ * Runs the application as stages on separate threads, connected by bounded queues:
+ * capture (grab_frame) -> fusion (process_frame on the GPU) -> visualization (this thread, which owns the window).
+ * A key press, SIGINT, the frame limit or the end of the stream stops capturing; the fusion stage processes the queued
+ * frames, extracts the requested results and hands them to an export thread, which writes them to disk. With
+ * export_every, intermediate results are exported the same way while processing.
+ * In headless mode no window is created and the exports are given by the options alone.
+ * The capture queue blocks the camera while the fusion stage is busy (unless a live camera should only deliver the
+ * latest frame), while the visualization only ever shows the latest model frame, so throughput is limited by the
+ * slowest stage instead of the sum of all stages.
+ */
+void main_loop(const std::unique_ptr<DepthCamera> camera, const kinectfusion::GlobalConfiguration& configuration,
+               const RunOptions& options)
 {
-    kinectfusion::Pipeline pipeline { camera->get_parameters(), configuration };
-
-    cv::namedWindow("Pipeline Output");
-    for (bool end = false; !end;) {
-        //1 Get frame
-        InputFrame frame = camera->grab_frame();
-
-        //2 Process frame
-        bool success = pipeline.process_frame(frame.depth_map, frame.color_map);
-        if (!success)
-            std::cout << "Frame could not be processed" << std::endl;
-
-        //3 Display the output
-        cv::imshow("Pipeline Output", pipeline.get_last_model_frame());
-
-        switch (cv::waitKey(1)) {
-            case 'a': { // Save all available data
-                std::cout << "Saving all ..." << std::endl;
-                std::cout << "Saving poses ..." << std::endl;
-                auto poses = pipeline.get_poses();
-
-                for (size_t i = 0; i < poses.size(); ++i) {
-                    std::stringstream file_name {};
-                    file_name << data_path << "poses/" << recording_name << "/seq_pose" << std::setfill('0')
-                              << std::setw(5) << i << ".txt";
-                    std::ofstream { file_name.str() } << poses[i] << std::endl;
+    BoundedQueue<InputFrame> capture_queue { options.capture_queue_size, options.capture_policy };
+    BoundedQueue<DisplayFrame> visualization_queue { 1, OverflowPolicy::DropOldest };
+    BoundedQueue<std::function<void()>> export_queue { 8, OverflowPolicy::Block };
+
+    std::atomic<unsigned> exports { options.exports };
+    std::atomic<bool> fusion_finished { false };
+    std::atomic<size_t> processed_frames { 0 };
+    size_t shown_model_frames = 0, skipped_model_frames = 0;
+    std::exception_ptr capture_error {}, fusion_error {}, export_error {};
+
+    // Created up front, as the fusion stage prepares the frames at the size of its panels
+    const bool show_output = configuration.use_output_frame && !options.headless;
+    std::unique_ptr<Dashboard> dashboard {};
+    if (show_output && options.visualization.dashboard)
+        dashboard.reset(new Dashboard { camera->get_parameters(), options.visualization.scale,
+                                        configuration.depth_cutoff_distance });
+    const cv::Size panel_size = dashboard ? dashboard->get_panel_size() : cv::Size {};
+
+    // Frames in the capture queue, being pushed by the capture stage and being processed by the fusion stage
+    camera->set_held_frames(options.capture_queue_size + 2);
+
+    const auto start_time = std::chrono::steady_clock::now();
+    ScopedTimer main_loop_timer { main_loop_stage };
+
+    //1 Capture frames until the camera ends or the application is stopped
+    std::thread capture_thread { [&] {
+        Tracer::set_thread_name("capture");
+        try {
+            for (size_t captured = 0; options.max_frames == 0 || captured < options.max_frames; ++captured) {
+                if (camera->end_of_stream())
+                    break;
+
+                ScopedTimer grab_timer { grab_stage };
+                InputFrame frame = camera->grab_frame();
+                grab_timer.stop();
+
+                ScopedTimer wait_timer { capture_wait_stage };
+                if (!capture_queue.push(std::move(frame)))
+                    break;
+                Tracer::counter(capture_queue_counter, static_cast<int64_t>(capture_queue.size()));
+            }
+        } catch (...) {
+            capture_error = std::current_exception();
+        }
+        capture_queue.close();
+    } };
+
+    //2 Process the frames and extract the results that should be exported
+    std::thread fusion_thread { [&] {
+        Tracer::set_thread_name("fusion");
+        try {
+            cv::cuda::setDevice(options.cuda_device);
+            kinectfusion::Pipeline pipeline { camera->get_parameters(), configuration };
+
+            // Reused for every frame, so the depth conversion does not allocate
+            cv::Mat_<float> depth_map {};
+
+            // Passed to the pipeline for frames without color
+            const auto cam_params = camera->get_parameters();
+            const cv::Mat_<cv::Vec3b> black_color_map { cam_params.image_height, cam_params.image_width,
+                                                        cv::Vec3b { 0, 0, 0 } };
+
+            // Frames in the visualization queue, being shown and being written
+            std::vector<DisplayFrame> display_frames(3);
+            const auto is_unused = [](const DisplayFrame& display_frame) {
+                return FramePool::is_unused(display_frame.model_frame) &&
+                       FramePool::is_unused(display_frame.depth_map) &&
+                       FramePool::is_unused(display_frame.color_map);
+            };
+            const std::chrono::duration<double> min_display_interval {
+                    options.visualization.max_fps > 0 ? 1. / options.visualization.max_fps : 0. };
+            std::chrono::steady_clock::time_point last_display {};
+
+            // The pipeline only stores a pose for each frame it could track; these are the numbers of these frames
+            // in the stream (the capture queue does not drop frames of recordings, so they match the camera's)
+            std::vector<size_t> pose_frames {};
+
+            // Extracts the selected results here, as the pipeline is not thread-safe, and leaves writing them to the
+            // export thread. Names are suffixed to distinguish intermediate exports.
+            const auto queue_exports = [&](const unsigned selected_exports, const std::string& suffix) {
+                const std::string name = recording_name + suffix;
+                ScopedTimer timer { export_extract_stage };
+                if (selected_exports & ExportPoses) {
+                    std::cout << "Saving poses ..." << std::endl;
+                    const auto poses = pipeline.get_poses();
+                    const std::string poses_directory = options.output_dir + "poses/" + name + "/";
+                    export_queue.push([&camera, poses, pose_frames, poses_directory] {
+                        export_poses(poses, pose_frames, poses_directory);
+                        export_ground_truth_poses(*camera, pose_frames, poses_directory);
+                    });
+                }
+                if (selected_exports & ExportMesh) {
+                    std::cout << "Extracting mesh ..." << std::endl;
+                    const auto mesh = pipeline.extract_mesh();
+                    std::cout << "Saving mesh ..." << std::endl;
+                    const std::string mesh_file = options.output_dir + "meshes/" + name + ".ply";
+                    export_queue.push([mesh, mesh_file] { export_mesh(mesh, mesh_file); });
+                }
+                if (selected_exports & ExportCloud) {
+                    std::cout << "Extracting point cloud ..." << std::endl;
+                    const auto cloud = pipeline.extract_pointcloud();
+                    std::cout << "Saving point cloud ..." << std::endl;
+                    const std::string cloud_file = options.output_dir + "clouds/" + name + ".ply";
+                    export_queue.push([cloud, cloud_file] { export_pointcloud(cloud, cloud_file); });
+                }
+                Tracer::counter(export_queue_counter, static_cast<int64_t>(export_queue.size()));
+            };
+
+            InputFrame frame {};
+            while (capture_queue.pop(frame)) {
+                Tracer::counter(capture_queue_counter, static_cast<int64_t>(capture_queue.size()));
+                Tracer::counter(frame_counter, static_cast<int64_t>(processed_frames));
+
+                ScopedTimer convert_timer { convert_stage };
+                convert_depth(frame.depth_map, frame.depth_scale, depth_map);
+                convert_timer.stop();
+
+                ScopedTimer process_timer { process_stage };
+                bool success = pipeline.process_frame(depth_map,
+                                                      frame.color_map.empty() ? black_color_map : frame.color_map);
+                process_timer.stop();
+                const size_t frame_number = ++processed_frames;
+                if (success)
+                    pose_frames.push_back(frame_number - 1);
+                else
+                    std::cout << "Frame could not be processed" << std::endl;
+
+                const auto now = std::chrono::steady_clock::now();
+                const bool show_model_frame = configuration.use_output_frame &&
+                                              (frame_number - 1) % options.visualization.every_nth == 0 &&
+                                              now - last_display >= min_display_interval &&
+                                              visualization_queue.size() == 0;
+                if (show_model_frame) {
+                    ScopedTimer timer { model_frame_stage };
+                    last_display = now;
+                    ++shown_model_frames;
+
+                    // The pipeline reuses its output buffer and the camera its frames, so they are copied (or
+                    // downscaled) into ones that are not in use
+                    auto display_frame = std::find_if(display_frames.begin(), display_frames.end(), is_unused);
+                    DisplayFrame output = display_frame != display_frames.end() ? *display_frame : DisplayFrame {};
+                    if (dashboard) {
+                        cv::resize(pipeline.get_last_model_frame(), output.model_frame, panel_size, 0, 0,
+                                   cv::INTER_AREA);
+                        cv::resize(depth_map, output.depth_map, panel_size, 0, 0, cv::INTER_NEAREST);
+                        if (!frame.color_map.empty())
+                            cv::resize(frame.color_map, output.color_map, panel_size, 0, 0, cv::INTER_AREA);
+                        else
+                            output.color_map.release();
+                    } else if (options.visualization.scale < 1.) {
+                        cv::resize(pipeline.get_last_model_frame(), output.model_frame, cv::Size {},
+                                   options.visualization.scale, options.visualization.scale, cv::INTER_AREA);
+                    } else {
+                        pipeline.get_last_model_frame().copyTo(output.model_frame);
+                    }
+                    if (display_frame != display_frames.end())
+                        *display_frame = output;
+                    visualization_queue.push(std::move(output));
+                } else if (configuration.use_output_frame) {
+                    ++skipped_model_frames;
                 }
 
-                std::cout << "Extracting mesh ..." << std::endl;
-                auto mesh = pipeline.extract_mesh();
-                std::cout << "Saving mesh ..." << std::endl;
-                std::stringstream file_name {};
-                file_name << data_path << "meshes/" << recording_name << ".ply";
-                kinectfusion::export_ply(file_name.str(), mesh);
-                end = true;
-                break;
+                // Return the buffers to the camera
+                frame = InputFrame {};
+
+                if (options.export_every > 0 && processed_frames % options.export_every == 0) {
+                    std::stringstream suffix {};
+                    suffix << "_" << std::setfill('0') << std::setw(5) << processed_frames;
+                    queue_exports(options.exports, suffix.str());
+                }
             }
-            case 'p': { // Save poses only
-                std::cout << "Saving poses ..." << std::endl;
-                auto poses = pipeline.get_poses();
-
-                for (size_t i = 0; i < poses.size(); ++i) {
-                    std::stringstream file_name {};
-                    file_name << data_path << "poses/" << recording_name << "/seq_pose" << std::setfill('0')
-                              << std::setw(5) << i << ".txt";
-                    std::ofstream { file_name.str() } << poses[i] << std::endl;
+
+            queue_exports(exports, "");
+
+        } catch (...) {
+            fusion_error = std::current_exception();
+            capture_queue.close();
+        }
+        visualization_queue.close();
+        export_queue.close();
+        fusion_finished = true;
+    } };
+
+    //3 Write the extracted results to disk
+    std::thread export_thread { [&] {
+        Tracer::set_thread_name("export");
+        std::function<void()> job {};
+        while (export_queue.pop(job)) {
+            try {
+                ScopedTimer timer { export_write_stage };
+                job();
+                Tracer::counter(export_queue_counter, static_cast<int64_t>(export_queue.size()));
+            } catch (...) {
+                export_error = std::current_exception();
+            }
+        }
+    } };
+
+    //4 Display the output and wait for keys or SIGINT
+    Tracer::set_thread_name("main");
+    // Keys are only received by a window, so there is one without model frames, too, listing the keys
+    const bool show_window = !options.headless;
+    if (show_window) {
+        cv::namedWindow("Pipeline Output");
+        if (!show_output) {
+            cv::Mat keys { 60, 480, CV_8UC3, cv::Scalar::all(0) };
+            cv::putText(keys, "Stop and save: a all, p poses, m mesh, space nothing", cv::Point { 10, 36 },
+                        cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar::all(255), 1, cv::LINE_AA);
+            cv::imshow("Pipeline Output", keys);
+        }
+    }
+    DisplayFrame display_frame {};
+    // The dashboard's status is only refreshed once per interval, as collecting the statistics allocates
+    const std::chrono::seconds status_interval { 1 };
+    auto last_status = start_time;
+    size_t last_status_frames = 0;
+    while (!fusion_finished) {
+        if (show_window) {
+            if (dashboard) {
+                const auto now = std::chrono::steady_clock::now();
+                if (now - last_status >= status_interval) {
+                    const size_t frames = processed_frames;
+                    const double seconds = std::chrono::duration<double> { now - last_status }.count();
+                    dashboard->set_status(static_cast<double>(frames - last_status_frames) / seconds,
+                                          Profiler::collect());
+                    last_status = now;
+                    last_status_frames = frames;
                 }
-                end = true;
-                break;
             }
-            case 'm': { // Save mesh only
-                std::cout << "Extracting mesh ..." << std::endl;
-                auto mesh = pipeline.extract_mesh();
-                std::cout << "Saving mesh ..." << std::endl;
-                std::stringstream file_name {};
-                file_name << data_path << "meshes/" << recording_name << ".ply";
-                kinectfusion::export_ply(file_name.str(), mesh);
-                end = true;
-                break;
+
+            if (show_output && visualization_queue.try_pop(display_frame)) {
+                ScopedTimer timer { imshow_stage };
+                if (dashboard) {
+                    dashboard->update(display_frame);
+                    cv::imshow("Pipeline Output", dashboard->get_canvas());
+                } else {
+                    cv::imshow("Pipeline Output", display_frame.model_frame);
+                }
             }
-            case ' ': // Save nothing
-                end = true;
-                break;
-            default:
-                break;
+
+            const int key_export = key_exports(cv::waitKey(1));
+            if (key_export >= 0) {
+                exports = static_cast<unsigned>(key_export);
+                capture_queue.close();
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds { 10 });
         }
+
+        if (interrupted)
+            capture_queue.close();
+    }
+    if (show_window)
+        cv::destroyWindow("Pipeline Output");
+
+    capture_thread.join();
+    fusion_thread.join();
+    export_thread.join();
+    main_loop_timer.stop();
+    for (const auto& error : { capture_error, fusion_error, export_error }) {
+        if (error)
+            std::rethrow_exception(error);
     }
+
+    const auto elapsed = std::chrono::duration<double> { std::chrono::steady_clock::now() - start_time }.count();
+    std::cout << "Processed " << processed_frames << " frames in " << elapsed << "s ("
+              << (elapsed > 0 ? static_cast<double>(processed_frames) / elapsed : 0.) << " fps)" << std::endl;
+    camera->print_statistics(std::cout);
+    print_queue_statistics(std::cout, "Capture", capture_queue);
+    print_queue_statistics(std::cout, "Visualization", visualization_queue);
+    if (configuration.use_output_frame) {
+        // The pipeline still downloads every model frame from the GPU; skipped frames save the copy and the display
+        std::cout << "Model frames: " << shown_model_frames << " shown, " << skipped_model_frames
+                  << " host copies skipped by the visualization policy" << std::endl;
+    }
+
+    Profiler::print(std::cout);
+    if (!options.stats_json.empty())
+        Profiler::write_json(options.stats_json);
+    if (!options.stats_csv.empty())
+        Profiler::write_csv(options.stats_csv);
 }
 
-void setup_cuda_device()
+int setup_cuda_device()
 {
     auto n_devices = cv::cuda::getCudaEnabledDeviceCount();
     std::cout << "Found " << n_devices << " CUDA devices" << std::endl;
@@ -158,31 +679,107 @@ void setup_cuda_device()
     // Hardcoded to first device; change if necessary
     std::cout << "Using device #0" << std::endl;
     cv::cuda::setDevice(0);
+    return 0;
 }
 
 int main(int argc, char* argv[])
 {
+    const auto start_time = std::chrono::steady_clock::now();
+
     // Parse command line options
     cxxopts::Options options { "KinectFusionApp",
                                "Sample application for KinectFusionLib, a modern implementation of the KinectFusion approach"};
-    options.add_options()("c,config", "Configuration filename", cxxopts::value<std::string>());
+    options.add_options()
+            ("c,config", "Configuration filename", cxxopts::value<std::string>())
+            ("headless", "Run without window until the end of the stream or SIGINT")
+            ("export", "Comma separated results to save at the end: poses, mesh, cloud, all or none",
+             cxxopts::value<std::string>()->default_value("none"))
+            ("frames", "Stop after this many frames (0: until the end of the stream)",
+             cxxopts::value<size_t>()->default_value("0"))
+            ("export-every", "Also save the exports after every N frames (0: only at the end)",
+             cxxopts::value<size_t>()->default_value("0"))
+            ("output-dir", "Directory to save the exports to (default: data_path)", cxxopts::value<std::string>())
+            ("stats-json", "Write the latencies of the stages to this JSON file", cxxopts::value<std::string>())
+            ("stats-csv", "Write the latencies of the stages to this CSV file", cxxopts::value<std::string>())
+            ("trace", "Record a timeline of the stages and write it to this Chrome trace (JSON) file",
+             cxxopts::value<std::string>());
     auto program_arguments = options.parse(argc, argv);
     if (program_arguments.count("config") == 0)
         throw std::invalid_argument("You have to specify a path to the configuration file");
 
+    RunOptions run_options {};
+    run_options.headless = program_arguments.count("headless") > 0;
+    run_options.exports = parse_exports(program_arguments["export"].as<std::string>());
+    run_options.max_frames = program_arguments["frames"].as<size_t>();
+    run_options.export_every = program_arguments["export-every"].as<size_t>();
+    if (program_arguments.count("stats-json") > 0)
+        run_options.stats_json = program_arguments["stats-json"].as<std::string>();
+    if (program_arguments.count("stats-csv") > 0)
+        run_options.stats_csv = program_arguments["stats-csv"].as<std::string>();
+
     // Parse TOML configuration file
     auto toml_config = cpptoml::parse_file(program_arguments["config"].as<std::string>());
     data_path = *toml_config->get_as<std::string>("data_path");
     recording_name = *toml_config->get_as<std::string>("recording_name");
 
+    run_options.output_dir = program_arguments.count("output-dir") > 0 ?
+                             program_arguments["output-dir"].as<std::string>() : data_path;
+    if (!run_options.output_dir.empty() && run_options.output_dir.back() != '/')
+        run_options.output_dir += '/';
+
     // Print info about available CUDA devices and specify device to use
-    setup_cuda_device();
+    run_options.cuda_device = setup_cuda_device();
+
+    // Without a window the model frame is not needed
+    auto configuration = make_configuration(toml_config);
+    if (run_options.headless)
+        configuration.use_output_frame = false;
+
+    // Stop gracefully on Ctrl+C, so the requested results are still exported
+    std::signal(SIGINT, [](int) { interrupted = true; });
+
+    // Trace from the start, so the camera's decoding threads are included
+    if (program_arguments.count("trace") > 0)
+        Tracer::enable();
 
     // Start the program's main loop
+    run_options.visualization.max_fps = std::max(
+            toml_config->get_qualified_as<double>("visualization.max_fps").value_or(0.), 0.);
+    run_options.visualization.every_nth = static_cast<size_t>(std::max(
+            toml_config->get_qualified_as<int>("visualization.every_nth").value_or(1), 1));
+    run_options.visualization.scale = std::min(std::max(
+            toml_config->get_qualified_as<double>("visualization.scale").value_or(1.), 0.05), 1.);
+    run_options.visualization.dashboard =
+            toml_config->get_qualified_as<bool>("visualization.dashboard").value_or(false);
+    run_options.capture_queue_size = static_cast<size_t>(std::max(
+            toml_config->get_qualified_as<int>("stages.capture_queue_size").value_or(4), 1));
+    run_options.capture_policy = OverflowPolicy::Block;
+    // Queued frames would delay a live camera's latest frame, which the "latest" policy asks for; the camera's own
+    // queue already drops the older ones
+    if (*toml_config->get_qualified_as<std::string>("camera.type") == "RealSense" &&
+        toml_config->get_qualified_as<bool>("camera.realsense.live").value_or(false) &&
+        toml_config->get_qualified_as<std::string>("camera.realsense.capture_policy").value_or("latest") == "latest") {
+        run_options.capture_queue_size = 1;
+        run_options.capture_policy = OverflowPolicy::DropOldest;
+    }
     main_loop(
-            make_camera(toml_config),
-            make_configuration(toml_config)
+            make_camera(toml_config, configuration.use_output_frame, run_options.exports),
+            configuration,
+            run_options
     );
 
+    // Written only now, as the camera's threads may record until it is destroyed
+    if (program_arguments.count("trace") > 0) {
+        const auto trace_file = program_arguments["trace"].as<std::string>();
+        const size_t lost_events = Tracer::write_chrome_trace(trace_file);
+        std::cout << "Trace written to " << trace_file;
+        if (lost_events > 0)
+            std::cout << " (" << lost_events << " oldest events overwritten)";
+        std::cout << std::endl;
+    }
+
+    const auto wall_time = std::chrono::duration<double> { std::chrono::steady_clock::now() - start_time }.count();
+    std::cout << "Total wall time: " << wall_time << "s" << std::endl;
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,344 @@
+#include <profiling.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    // Only the owning thread writes, so a relaxed load and store is enough and avoids locked instructions
+    void add_relaxed(std::atomic<uint64_t>& counter, const uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    struct TraceEvent {
+        enum class Type : uint32_t { Span, Counter };
+
+        Type type;
+        uint32_t name;          // Stage or counter id
+        int64_t timestamp;      // Nanoseconds since the tracer was enabled
+        int64_t value;          // Duration in nanoseconds or counter value
+    };
+
+    struct ThreadRecords {
+        std::mutex mutex;   // Guards the growth of histograms and the allocation of trace against readers
+        std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+
+        // Ring of trace events; only the owning thread writes, written is published after each event
+        std::vector<TraceEvent> trace;
+        std::atomic<uint64_t> written { 0 };
+        std::string name;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::string> stage_names;
+        // Kept alive beyond the end of their threads, so their measurements are still collected
+        std::vector<std::shared_ptr<ThreadRecords>> threads;
+
+        size_t events_per_thread { 0 };
+        std::chrono::steady_clock::time_point trace_start {};
+    };
+
+    Registry& registry()
+    {
+        static Registry instance {};
+        return instance;
+    }
+
+    ThreadRecords& thread_records()
+    {
+        thread_local const std::shared_ptr<ThreadRecords> records = [] {
+            auto thread = std::make_shared<ThreadRecords>();
+            std::lock_guard<std::mutex> lock { registry().mutex };
+            registry().threads.push_back(thread);
+            return thread;
+        }();
+        return *records;
+    }
+
+    void trace(const TraceEvent& event)
+    {
+        auto& thread = thread_records();
+        if (thread.trace.empty()) {
+            std::lock_guard<std::mutex> lock { thread.mutex };
+            thread.trace.resize(std::max<size_t>(registry().events_per_thread, 1));
+        }
+
+        const uint64_t index = thread.written.load(std::memory_order_relaxed);
+        thread.trace[index % thread.trace.size()] = event;
+        thread.written.store(index + 1, std::memory_order_release);
+    }
+
+    int64_t trace_time(const std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - registry().trace_start).count();
+    }
+
+    double to_milliseconds(const uint64_t nanoseconds)
+    {
+        return static_cast<double>(nanoseconds) / 1e6;
+    }
+}
+
+// ### LatencyHistogram ###
+LatencyHistogram::LatencyHistogram() :
+        counts{}, total_count{0}, total_sum{0}, max_value{0}
+{
+}
+
+void LatencyHistogram::record(const uint64_t nanoseconds)
+{
+    add_relaxed(counts[bucket_index(nanoseconds)], 1);
+    add_relaxed(total_count, 1);
+    add_relaxed(total_sum, nanoseconds);
+    if (nanoseconds > max_value.load(std::memory_order_relaxed))
+        max_value.store(nanoseconds, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < bucket_count; ++i)
+        add_relaxed(counts[i], other.counts[i].load(std::memory_order_relaxed));
+    add_relaxed(total_count, other.count());
+    add_relaxed(total_sum, other.sum());
+    max_value.store(std::max(max(), other.max()), std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return total_count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::sum() const
+{
+    return total_sum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const
+{
+    return max_value.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(const double fraction) const
+{
+    const uint64_t rank = std::max<uint64_t>(
+            static_cast<uint64_t>(std::ceil(std::min(std::max(fraction, 0.), 1.) * static_cast<double>(count()))), 1);
+
+    uint64_t cumulative = 0;
+    for (int i = 0; i < bucket_count; ++i) {
+        cumulative += counts[i].load(std::memory_order_relaxed);
+        if (cumulative >= rank) {
+            const uint64_t width = bucket_lower_bound(i + 1) - bucket_lower_bound(i);
+            return std::min(bucket_lower_bound(i) + width / 2, max());
+        }
+    }
+    return max();
+}
+
+int LatencyHistogram::bucket_index(const uint64_t value)
+{
+    // Values below sub_buckets get a bucket each, above that the top bits select the power of two and sub-bucket
+    if (value < sub_buckets)
+        return static_cast<int>(value);
+    const int highest_bit = 63 - __builtin_clzll(value);
+    const int shift = highest_bit - sub_bucket_bits;
+    return (shift + 1) * sub_buckets + static_cast<int>((value >> shift) & (sub_buckets - 1));
+}
+
+uint64_t LatencyHistogram::bucket_lower_bound(const int index)
+{
+    if (index < sub_buckets)
+        return static_cast<uint64_t>(index);
+    if (index >= bucket_count)
+        return UINT64_MAX;
+    const int shift = index / sub_buckets - 1;
+    return static_cast<uint64_t>(sub_buckets + index % sub_buckets) << shift;
+}
+
+// ### Profiler ###
+size_t Profiler::register_stage(const std::string& name)
+{
+    auto& instance = registry();
+    std::lock_guard<std::mutex> lock { instance.mutex };
+    const auto existing = std::find(instance.stage_names.begin(), instance.stage_names.end(), name);
+    if (existing != instance.stage_names.end())
+        return static_cast<size_t>(existing - instance.stage_names.begin());
+    instance.stage_names.push_back(name);
+    return instance.stage_names.size() - 1;
+}
+
+void Profiler::record(const size_t stage, const uint64_t nanoseconds)
+{
+    auto& thread = thread_records();
+    if (stage >= thread.histograms.size() || !thread.histograms[stage]) {
+        // First measurement of this stage on this thread
+        std::lock_guard<std::mutex> lock { thread.mutex };
+        if (stage >= thread.histograms.size())
+            thread.histograms.resize(stage + 1);
+        thread.histograms[stage] = std::make_unique<LatencyHistogram>();
+    }
+    thread.histograms[stage]->record(nanoseconds);
+}
+
+std::vector<StageStatistics> Profiler::collect()
+{
+    auto& instance = registry();
+    std::lock_guard<std::mutex> lock { instance.mutex };
+
+    std::vector<StageStatistics> statistics {};
+    for (size_t stage = 0; stage < instance.stage_names.size(); ++stage) {
+        LatencyHistogram merged {};
+        for (const auto& thread : instance.threads) {
+            std::lock_guard<std::mutex> thread_lock { thread->mutex };
+            if (stage < thread->histograms.size() && thread->histograms[stage])
+                merged.merge(*thread->histograms[stage]);
+        }
+        if (merged.count() == 0)
+            continue;
+
+        statistics.push_back(StageStatistics {
+                instance.stage_names[stage], merged.count(),
+                to_milliseconds(merged.sum()) / static_cast<double>(merged.count()),
+                to_milliseconds(merged.percentile(0.5)), to_milliseconds(merged.percentile(0.9)),
+                to_milliseconds(merged.percentile(0.99)), to_milliseconds(merged.max()) });
+    }
+    return statistics;
+}
+
+void Profiler::print(std::ostream& stream)
+{
+    const auto statistics = collect();
+    if (statistics.empty())
+        return;
+
+    size_t name_width = 5;
+    for (const auto& stage : statistics)
+        name_width = std::max(name_width, stage.name.size());
+
+    const auto flags = stream.flags();
+    stream << std::left << std::setw(static_cast<int>(name_width)) << "Stage" << std::right
+           << std::setw(10) << "count" << std::setw(11) << "mean [ms]" << std::setw(10) << "p50"
+           << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+    stream << std::fixed << std::setprecision(3);
+    for (const auto& stage : statistics) {
+        stream << std::left << std::setw(static_cast<int>(name_width)) << stage.name << std::right
+               << std::setw(10) << stage.count << std::setw(11) << stage.mean_ms << std::setw(10) << stage.p50_ms
+               << std::setw(10) << stage.p90_ms << std::setw(10) << stage.p99_ms << std::setw(10) << stage.max_ms
+               << std::endl;
+    }
+    stream.flags(flags);
+}
+
+void Profiler::write_json(const std::string& file_name)
+{
+    std::ofstream file { file_name };
+    if (!file)
+        throw std::runtime_error{"Statistics file " + file_name + " could not be created"};
+
+    // Stage names are identifiers chosen by the application, so they do not need escaping
+    file << std::setprecision(6) << "{\n  \"stages\": [";
+    const auto statistics = collect();
+    for (size_t i = 0; i < statistics.size(); ++i) {
+        const auto& stage = statistics[i];
+        file << (i > 0 ? "," : "") << "\n    { \"name\": \"" << stage.name << "\", \"count\": " << stage.count
+             << ", \"mean_ms\": " << stage.mean_ms << ", \"p50_ms\": " << stage.p50_ms
+             << ", \"p90_ms\": " << stage.p90_ms << ", \"p99_ms\": " << stage.p99_ms
+             << ", \"max_ms\": " << stage.max_ms << " }";
+    }
+    file << "\n  ]\n}" << std::endl;
+}
+
+void Profiler::write_csv(const std::string& file_name)
+{
+    std::ofstream file { file_name };
+    if (!file)
+        throw std::runtime_error{"Statistics file " + file_name + " could not be created"};
+
+    file << std::setprecision(6) << "stage,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n";
+    for (const auto& stage : collect()) {
+        file << stage.name << ',' << stage.count << ',' << stage.mean_ms << ',' << stage.p50_ms << ','
+             << stage.p90_ms << ',' << stage.p99_ms << ',' << stage.max_ms << '\n';
+    }
+}
+
+// ### Tracer ###
+std::atomic<bool> Tracer::enabled { false };
+
+void Tracer::enable(const size_t events_per_thread)
+{
+    auto& instance = registry();
+    {
+        std::lock_guard<std::mutex> lock { instance.mutex };
+        instance.events_per_thread = events_per_thread;
+        instance.trace_start = std::chrono::steady_clock::now();
+    }
+    enabled = true;
+}
+
+void Tracer::set_thread_name(const std::string& name)
+{
+    auto& thread = thread_records();
+    std::lock_guard<std::mutex> lock { thread.mutex };
+    thread.name = name;
+}
+
+void Tracer::span(const size_t stage, const std::chrono::steady_clock::time_point start, const uint64_t nanoseconds)
+{
+    trace(TraceEvent { TraceEvent::Type::Span, static_cast<uint32_t>(stage), trace_time(start),
+                       static_cast<int64_t>(nanoseconds) });
+}
+
+void Tracer::counter(const size_t counter, const int64_t value)
+{
+    if (!is_enabled())
+        return;
+    trace(TraceEvent { TraceEvent::Type::Counter, static_cast<uint32_t>(counter),
+                       trace_time(std::chrono::steady_clock::now()), value });
+}
+
+size_t Tracer::write_chrome_trace(const std::string& file_name)
+{
+    std::ofstream file { file_name };
+    if (!file)
+        throw std::runtime_error{"Trace file " + file_name + " could not be created"};
+
+    auto& instance = registry();
+    std::lock_guard<std::mutex> lock { instance.mutex };
+
+    // Timestamps and durations are in microseconds
+    file << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    const char* separator = "\n";
+    size_t lost_events = 0;
+    for (size_t tid = 0; tid < instance.threads.size(); ++tid) {
+        auto& thread = *instance.threads[tid];
+        std::lock_guard<std::mutex> thread_lock { thread.mutex };
+        if (!thread.name.empty()) {
+            file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                 << ",\"args\":{\"name\":\"" << thread.name << "\"}}";
+            separator = ",\n";
+        }
+        if (thread.trace.empty())
+            continue;
+
+        const uint64_t written = thread.written.load(std::memory_order_acquire);
+        const uint64_t first = written > thread.trace.size() ? written - thread.trace.size() : 0;
+        lost_events += first;
+        for (uint64_t i = first; i < written; ++i) {
+            const auto& event = thread.trace[i % thread.trace.size()];
+            file << separator << "{\"name\":\"" << instance.stage_names[event.name] << "\",\"pid\":1,\"tid\":"
+                 << tid << ",\"ts\":" << static_cast<double>(event.timestamp) / 1e3;
+            if (event.type == TraceEvent::Type::Span)
+                file << ",\"ph\":\"X\",\"dur\":" << static_cast<double>(event.value) / 1e3 << "}";
+            else
+                file << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+            separator = ",\n";
+        }
+    }
+    file << "\n]}" << std::endl;
+    return lost_events;
+}
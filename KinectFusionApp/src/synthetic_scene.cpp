@@ -0,0 +1,190 @@
+#include <synthetic_scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <Eigen/Geometry>
+#include <opencv2/core/utility.hpp>
+#pragma GCC diagnostic pop
+
+namespace {
+    // Sphere tracing stops once a surface is closer than this (in mm), relative to the distance travelled
+    constexpr float hit_epsilon = 0.1f;
+    constexpr float relative_hit_epsilon = 1e-4f;
+    constexpr int max_steps = 128;
+
+    class RowRenderer : public cv::ParallelLoopBody {
+    public:
+        explicit RowRenderer(const std::function<void(int, int)>& _render_rows) : render_rows(_render_rows) {}
+
+        void operator()(const cv::Range& range) const override
+        {
+            render_rows(range.start, range.end);
+        }
+
+    private:
+        const std::function<void(int, int)>& render_rows;
+    };
+}
+
+float SdfPrimitive::distance(const Eigen::Vector3f& point) const
+{
+    switch (type) {
+        case Type::Sphere:
+            return (point - position).norm() - size.x();
+        case Type::Box: {
+            const Eigen::Vector3f q = (point - position).cwiseAbs() - size;
+            return q.cwiseMax(0.f).norm() + std::min(q.maxCoeff(), 0.f);
+        }
+        case Type::Plane:
+            return (point - position).dot(size);
+    }
+    return std::numeric_limits<float>::max();
+}
+
+Eigen::Matrix4f OrbitTrajectory::pose(const size_t index) const
+{
+    const float angle = static_cast<float>(index) * degrees_per_frame * static_cast<float>(M_PI) / 180.f;
+    const Eigen::Vector3f position = center + Eigen::Vector3f { radius * std::sin(angle), -height,
+                                                                -radius * std::cos(angle) };
+
+    // Look at the center, keeping the image rows parallel to the xz-plane
+    const Eigen::Vector3f forward = (center - position).normalized();
+    const Eigen::Vector3f right = Eigen::Vector3f::UnitY().cross(forward).normalized();
+    const Eigen::Vector3f down = forward.cross(right);
+
+    Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+    pose.block<3, 1>(0, 0) = right;
+    pose.block<3, 1>(0, 1) = down;
+    pose.block<3, 1>(0, 2) = forward;
+    pose.block<3, 1>(0, 3) = position;
+    return pose;
+}
+
+void SyntheticScene::add(const SdfPrimitive& primitive)
+{
+    primitives.push_back(primitive);
+}
+
+bool SyntheticScene::empty() const
+{
+    return primitives.empty();
+}
+
+float SyntheticScene::distance(const Eigen::Vector3f& point, size_t& closest) const
+{
+    float min_distance = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        const float distance = primitives[i].distance(point);
+        if (distance < min_distance) {
+            min_distance = distance;
+            closest = i;
+        }
+    }
+    return min_distance;
+}
+
+void SyntheticScene::render(const Eigen::Matrix4f& pose, const CameraParameters& cam_params,
+                            const SensorModel& sensor, const size_t frame_index,
+                            cv::Mat_<uint16_t>& depth_map, cv::Mat_<cv::Vec3b>* color_map, const bool parallel) const
+{
+    depth_map.create(cam_params.image_height, cam_params.image_width);
+    if (color_map != nullptr)
+        color_map->create(cam_params.image_height, cam_params.image_width);
+
+    const std::function<void(int, int)> render_range = [&](const int first_row, const int last_row) {
+        render_rows(pose, cam_params, sensor, frame_index, first_row, last_row, depth_map, color_map);
+    };
+    if (parallel)
+        cv::parallel_for_(cv::Range { 0, cam_params.image_height }, RowRenderer { render_range });
+    else
+        render_range(0, cam_params.image_height);
+}
+
+void SyntheticScene::render_rows(const Eigen::Matrix4f& pose, const CameraParameters& cam_params,
+                                 const SensorModel& sensor, const size_t frame_index,
+                                 const int first_row, const int last_row,
+                                 cv::Mat_<uint16_t>& depth_map, cv::Mat_<cv::Vec3b>* color_map) const
+{
+    const Eigen::Matrix3f rotation = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f origin = pose.block<3, 1>(0, 3);
+
+    std::normal_distribution<float> noise { 0.f, 1.f };
+
+    for (int y = first_row; y < last_row; ++y) {
+        // Seeded per row, so the noise does not depend on how the rows are distributed over the threads
+        std::seed_seq seed { sensor.seed, static_cast<uint32_t>(frame_index), static_cast<uint32_t>(y) };
+        std::mt19937 generator { seed };
+
+        auto* depth_row = depth_map.ptr<uint16_t>(y);
+        auto* color_row = color_map != nullptr ? color_map->ptr<cv::Vec3b>(y) : nullptr;
+        for (int x = 0; x < cam_params.image_width; ++x) {
+            depth_row[x] = 0;
+            if (color_row != nullptr)
+                color_row[x] = cv::Vec3b { 0, 0, 0 };
+
+            // Depth is measured along the optical axis, the ray is marched along its unit direction
+            const Eigen::Vector3f camera_ray { (static_cast<float>(x) - cam_params.principal_x) / cam_params.focal_x,
+                                               (static_cast<float>(y) - cam_params.principal_y) / cam_params.focal_y,
+                                               1.f };
+            const float ray_length = camera_ray.norm();
+            const Eigen::Vector3f direction = rotation * camera_ray / ray_length;
+            const float max_distance = sensor.max_depth * ray_length;
+
+            float travelled = 0.f;
+            size_t closest = 0;
+            bool hit = false;
+            for (int step = 0; step < max_steps && travelled < max_distance; ++step) {
+                const float distance = this->distance(origin + travelled * direction, closest);
+                if (distance < hit_epsilon + relative_hit_epsilon * travelled) {
+                    hit = true;
+                    break;
+                }
+                travelled += distance;
+            }
+            if (!hit || travelled >= max_distance)
+                continue;
+
+            float depth = travelled / ray_length;
+            if (sensor.noise_stddev > 0.f) {
+                const float depth_meters = depth / 1000.f;
+                depth += noise(generator) * sensor.noise_stddev * depth_meters * depth_meters;
+            }
+            depth_row[x] = static_cast<uint16_t>(std::min(std::max(std::round(depth), 1.f), 65535.f));
+            if (color_row == nullptr)
+                continue;
+
+            // Central differences of the SDF give the surface normal
+            const Eigen::Vector3f surface = origin + travelled * direction;
+            const auto& primitive = primitives[closest];
+            const float h = 0.5f;
+            const Eigen::Vector3f normal = Eigen::Vector3f {
+                    primitive.distance(surface + Eigen::Vector3f { h, 0, 0 }) -
+                    primitive.distance(surface - Eigen::Vector3f { h, 0, 0 }),
+                    primitive.distance(surface + Eigen::Vector3f { 0, h, 0 }) -
+                    primitive.distance(surface - Eigen::Vector3f { 0, h, 0 }),
+                    primitive.distance(surface + Eigen::Vector3f { 0, 0, h }) -
+                    primitive.distance(surface - Eigen::Vector3f { 0, 0, h }) }.normalized();
+            const float shading = 0.2f + 0.8f * std::max(-normal.dot(direction), 0.f);
+            for (int channel = 0; channel < 3; ++channel)
+                color_row[x][channel] = static_cast<uchar>(primitive.color[channel] * shading);
+        }
+    }
+}
+
+SyntheticScene SyntheticScene::make_default()
+{
+    SyntheticScene scene {};
+    scene.add({ SdfPrimitive::Type::Plane, { 0.f, 300.f, 0.f }, { 0.f, -1.f, 0.f }, { 160, 160, 160 } });
+    scene.add({ SdfPrimitive::Type::Box, { 0.f, 150.f, 0.f }, { 150.f, 150.f, 150.f }, { 60, 90, 200 } });
+    scene.add({ SdfPrimitive::Type::Sphere, { 280.f, 200.f, -150.f }, { 100.f, 0.f, 0.f }, { 200, 120, 40 } });
+    scene.add({ SdfPrimitive::Type::Sphere, { -250.f, 100.f, 200.f }, { 200.f, 0.f, 0.f }, { 70, 180, 70 } });
+    return scene;
+}
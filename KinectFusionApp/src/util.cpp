@@ -0,0 +1,251 @@
+#include <util.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// The AVX2 kernel is compiled regardless of the build flags and chosen at runtime, so generic builds use it, too.
+// SSE2 is part of every x86-64 build.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KINECTFUSION_X86_SIMD
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+#if defined(KINECTFUSION_X86_SIMD)
+    // The part of scale_components() covered by blocks of 32 components; returns where the remainder starts
+    __attribute__((target("avx2")))
+    int scale_components_avx2(const float* source, uchar* destination, const int count)
+    {
+        int i = 0;
+        const __m256 one = _mm256_set1_ps(1.f), half = _mm256_set1_ps(0.5f), scale = _mm256_set1_ps(255.f);
+        // Packing works within the 128 bit lanes; this restores the order of the 32 bit groups
+        const __m256i lane_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for (; i + 32 <= count; i += 32) {
+            __m256i values[4];
+            for (int j = 0; j < 4; ++j) {
+                const __m256 components = _mm256_loadu_ps(source + i + 8 * j);
+                values[j] = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(components, one), half),
+                                                              scale));
+            }
+            const __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(values[0], values[1]),
+                                                      _mm256_packs_epi32(values[2], values[3]));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i),
+                                _mm256_permutevar8x32_epi32(bytes, lane_order));
+        }
+        return i;
+    }
+#endif
+
+    /*
+     * Converts count normal components to (component + 1) / 2 * 255, truncated and saturated to [0, 255].
+     * The operations are the same in every path, so all of them produce the same bytes.
+     */
+    void scale_components(const float* source, uchar* destination, const int count)
+    {
+        int i = 0;
+
+#if defined(KINECTFUSION_X86_SIMD)
+        static const bool has_avx2 = cv::checkHardwareSupport(CV_CPU_AVX2);
+        if (has_avx2)
+            i = scale_components_avx2(source, destination, count);
+#endif
+
+#if defined(__SSE2__)
+        const __m128 one = _mm_set1_ps(1.f), half = _mm_set1_ps(0.5f), scale = _mm_set1_ps(255.f);
+        for (; i + 16 <= count; i += 16) {
+            __m128i values[4];
+            for (int j = 0; j < 4; ++j) {
+                const __m128 components = _mm_loadu_ps(source + i + 4 * j);
+                values[j] = _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_add_ps(components, one), half), scale));
+            }
+            const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(values[0], values[1]),
+                                                   _mm_packs_epi32(values[2], values[3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), bytes);
+        }
+#endif
+
+        for (; i < count; ++i) {
+            const float value = (source[i] + 1) / 2 * 255;
+            destination[i] = value >= 255.f ? 255 : value > 0.f ? static_cast<uchar>(value) : 0;
+        }
+    }
+
+    // Colors of cv::COLORMAP_JET for each 8 bit value, taken from OpenCV once, so the colors are identical
+    const std::array<cv::Vec3b, 256>& jet_colormap()
+    {
+        static const std::array<cv::Vec3b, 256> colormap = [] {
+            cv::Mat ramp(256, 1, CV_8UC1), colors;
+            for (int i = 0; i < 256; ++i)
+                ramp.at<uchar>(i, 0) = static_cast<uchar>(i);
+            cv::applyColorMap(ramp, colors, cv::COLORMAP_JET);
+
+            std::array<cv::Vec3b, 256> table {};
+            for (int i = 0; i < 256; ++i)
+                table[static_cast<size_t>(i)] = colors.at<cv::Vec3b>(i, 0);
+            return table;
+        }();
+        return colormap;
+    }
+
+    /*
+     * Converts count depth values to colormap indices: (depth - min_depth) * scale, clamped to [0, 255] and rounded
+     * to nearest (even), like cv::convertScaleAbs
+     */
+    template <typename Depth>
+    void depth_indices(const Depth* depth, uchar* indices, const int count, const float min_depth, const float scale)
+    {
+        int i = 0;
+
+#if defined(__SSE2__)
+        const __m128 min_128 = _mm_set1_ps(min_depth), scale_128 = _mm_set1_ps(scale);
+        const __m128 zero = _mm_setzero_ps(), max_index = _mm_set1_ps(255.f);
+        for (; i + 8 <= count; i += 8) {
+            __m128 values[2];
+            if (sizeof(Depth) == 2) {
+                const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i));
+                values[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, _mm_setzero_si128()));
+                values[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(raw, _mm_setzero_si128()));
+            } else {
+                values[0] = _mm_loadu_ps(reinterpret_cast<const float*>(depth + i));
+                values[1] = _mm_loadu_ps(reinterpret_cast<const float*>(depth + i + 4));
+            }
+            __m128i rounded[2];
+            for (int j = 0; j < 2; ++j) {
+                const __m128 scaled = _mm_mul_ps(_mm_sub_ps(values[j], min_128), scale_128);
+                rounded[j] = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(scaled, zero), max_index));
+            }
+            const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(rounded[0], rounded[1]), _mm_setzero_si128());
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(indices + i), bytes);
+        }
+#endif
+
+        for (; i < count; ++i) {
+            const float scaled = (static_cast<float>(depth[i]) - min_depth) * scale;
+            indices[i] = static_cast<uchar>(cvRound(std::min(std::max(scaled, 0.f), 255.f)));
+        }
+    }
+
+    template <typename Depth>
+    void color_depth_rows(const cv::Mat& depth_map, const float min_depth, const float scale, cv::Mat& output)
+    {
+        const auto& colormap = jet_colormap();
+
+        // Indices are computed for a block of pixels at a time, so they stay in the L1 cache for the lookup
+        constexpr int block_size = 256;
+        uchar indices[block_size];
+        for (int y = 0; y < depth_map.rows; ++y) {
+            const auto* depth = depth_map.ptr<Depth>(y);
+            auto* colors = output.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < depth_map.cols; x += block_size) {
+                const int count = std::min(block_size, depth_map.cols - x);
+                depth_indices(depth + x, indices, count, min_depth, scale);
+                for (int i = 0; i < count; ++i)
+                    colors[x + i] = colormap[indices[i]];
+            }
+        }
+    }
+
+    class NormalColorizer : public cv::ParallelLoopBody {
+    public:
+        NormalColorizer(const cv::Mat& _normal_map, cv::Mat& _output) : normal_map(_normal_map), output(_output) {}
+
+        void operator()(const cv::Range& range) const override
+        {
+            for (int y = range.start; y < range.end; ++y) {
+                const auto* normals = normal_map.ptr<float>(y);
+                auto* colors = output.ptr<uchar>(y);
+                scale_components(normals, colors, 3 * normal_map.cols);
+
+                // Pixels without normal become white; branchless, so the loop vectorizes
+                for (int x = 0; x < normal_map.cols; ++x) {
+                    const auto invalid = static_cast<uchar>(-static_cast<int>(normals[3 * x + 2] == 0.f));
+                    colors[3 * x] |= invalid;
+                    colors[3 * x + 1] |= invalid;
+                    colors[3 * x + 2] |= invalid;
+                }
+            }
+        }
+
+    private:
+        const cv::Mat& normal_map;
+        cv::Mat& output;
+    };
+}
+
+void color_normal(const cv::Mat& normal_map, cv::Mat& output)
+{
+    CV_Assert(normal_map.type() == CV_32FC3);
+
+    output.create(normal_map.size(), CV_8UC3);
+    cv::parallel_for_(cv::Range { 0, normal_map.rows }, NormalColorizer { normal_map, output });
+}
+
+cv::Mat color_normal(const cv::Mat& normal_map)
+{
+    cv::Mat output;
+    color_normal(normal_map, output);
+    return output;
+}
+
+void compute_normal_map(const cv::Mat& depth_map, const kinectfusion::CameraParameters& cam_params,
+                        cv::Mat& normal_map)
+{
+    CV_Assert(depth_map.type() == CV_32FC1);
+
+    normal_map.create(depth_map.size(), CV_32FC3);
+    const float inverse_focal_x = 1.f / cam_params.focal_x, inverse_focal_y = 1.f / cam_params.focal_y;
+    const auto vertex = [&](const int x, const int y, const float depth) {
+        return cv::Vec3f { (static_cast<float>(x) - cam_params.principal_x) * inverse_focal_x * depth,
+                           (static_cast<float>(y) - cam_params.principal_y) * inverse_focal_y * depth,
+                           depth };
+    };
+
+    for (int y = 0; y < depth_map.rows; ++y) {
+        const auto* depth = depth_map.ptr<float>(y);
+        const auto* depth_below = depth_map.ptr<float>(std::min(y + 1, depth_map.rows - 1));
+        auto* normals = normal_map.ptr<cv::Vec3f>(y);
+        for (int x = 0; x < depth_map.cols; ++x) {
+            normals[x] = cv::Vec3f { 0.f, 0.f, 0.f };
+            if (x + 1 == depth_map.cols || y + 1 == depth_map.rows
+                || depth[x] <= 0.f || depth[x + 1] <= 0.f || depth_below[x] <= 0.f)
+                continue;
+
+            const cv::Vec3f center = vertex(x, y, depth[x]);
+            const cv::Vec3f right = vertex(x + 1, y, depth[x + 1]) - center;
+            const cv::Vec3f below = vertex(x, y + 1, depth_below[x]) - center;
+            cv::Vec3f normal = right.cross(below);
+            const float length = std::sqrt(normal.dot(normal));
+            if (length == 0.f)
+                continue;
+            // The camera looks along +z, so normals facing it have a negative z component
+            normal *= (normal[2] > 0.f ? -1.f : 1.f) / length;
+            normals[x] = normal;
+        }
+    }
+}
+
+void color_depth(const cv::Mat& depth_map, const float min_depth, const float max_depth, cv::Mat& output)
+{
+    CV_Assert(depth_map.type() == CV_16UC1 || depth_map.type() == CV_32FC1);
+
+    output.create(depth_map.size(), CV_8UC3);
+    const float scale = max_depth > min_depth ? static_cast<float>(255. / (max_depth - min_depth)) : 0.f;
+    if (depth_map.type() == CV_16UC1)
+        color_depth_rows<uint16_t>(depth_map, min_depth, scale, output);
+    else
+        color_depth_rows<float>(depth_map, min_depth, scale, output);
+}
+
+cv::Mat color_depth(const cv::Mat& depth_map)
+{
+    double min, max;
+    cv::minMaxIdx(depth_map, &min, &max);
+
+    cv::Mat output;
+    color_depth(depth_map, static_cast<float>(min), static_cast<float>(max), output);
+    return output;
+}
@@ -0,0 +1,394 @@
+/*
+ * Compares benchmark results of a candidate build against a baseline and exits with a non-zero code if anything
+ * got slower. Reads the JSON written by kfapp_bench (-o) and by KinectFusionApp (--stats-json):
+ * - kfapp_bench: the repetitions of each benchmark are the samples; the tail is their 90th percentile
+ * - KinectFusionApp: every file is one run (e.g. a headless replay of a fixed recording), contributing its p50 and
+ *   p99 per stage as one sample each; the main_loop stage is the duration of the whole run
+ * Several files can be given per side, whose samples are pooled.
+ * An entry regressed if its median (or tail) grew by more than the threshold and, given enough samples, a one-sided
+ * Mann-Whitney U test finds the candidate significantly slower. An entry of the baseline missing in the candidate
+ * fails the comparison as well, unless allowed, as a benchmark that no longer runs would otherwise go unnoticed.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// cxxopts.hpp relies on <limits> being included before it
+#include <cxxopts.hpp>
+
+// ### JSON ###
+/*
+ * Just enough JSON for the result files: objects, arrays, strings without unicode escapes, numbers and literals
+ */
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type { Type::Null };
+    bool boolean { false };
+    double number { 0 };
+    std::string string {};
+    std::vector<JsonValue> array {};
+    std::vector<std::pair<std::string, JsonValue>> object {};
+
+    const JsonValue* find(const std::string& key) const
+    {
+        for (const auto& member : object) {
+            if (member.first == key)
+                return &member.second;
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(std::string _text) : text{std::move(_text)}, position{0}
+    {
+    }
+
+    JsonValue parse()
+    {
+        JsonValue value = parse_value();
+        skip_whitespace();
+        if (position != text.size())
+            fail("Unexpected trailing characters");
+        return value;
+    }
+
+private:
+    JsonValue parse_value()
+    {
+        skip_whitespace();
+        if (position >= text.size())
+            fail("Unexpected end of input");
+
+        JsonValue value {};
+        const char c = text[position];
+        if (c == '{') {
+            value.type = JsonValue::Type::Object;
+            ++position;
+            if (!consume('}')) {
+                do {
+                    skip_whitespace();
+                    std::string key = parse_string();
+                    if (!consume(':'))
+                        fail("Expected ':'");
+                    value.object.emplace_back(std::move(key), parse_value());
+                } while (consume(','));
+                if (!consume('}'))
+                    fail("Expected '}'");
+            }
+        } else if (c == '[') {
+            value.type = JsonValue::Type::Array;
+            ++position;
+            if (!consume(']')) {
+                do {
+                    value.array.push_back(parse_value());
+                } while (consume(','));
+                if (!consume(']'))
+                    fail("Expected ']'");
+            }
+        } else if (c == '"') {
+            value.type = JsonValue::Type::String;
+            value.string = parse_string();
+        } else if (text.compare(position, 4, "true") == 0 || text.compare(position, 5, "false") == 0) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = c == 't';
+            position += value.boolean ? 4 : 5;
+        } else if (text.compare(position, 4, "null") == 0) {
+            position += 4;
+        } else {
+            value.type = JsonValue::Type::Number;
+            size_t length = 0;
+            try {
+                value.number = std::stod(text.substr(position, 32), &length);
+            } catch (const std::exception&) {
+                fail("Invalid value");
+            }
+            position += length;
+        }
+        return value;
+    }
+
+    std::string parse_string()
+    {
+        if (!consume('"'))
+            fail("Expected a string");
+        std::string result {};
+        while (position < text.size() && text[position] != '"') {
+            char c = text[position++];
+            if (c == '\\' && position < text.size()) {
+                c = text[position++];
+                switch (c) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'u': fail("Unicode escapes are not supported");
+                    default: break; // '"', '\\' and '/' stand for themselves
+                }
+            }
+            result += c;
+        }
+        if (!consume('"'))
+            fail("Unterminated string");
+        return result;
+    }
+
+    bool consume(const char c)
+    {
+        skip_whitespace();
+        if (position < text.size() && text[position] == c) {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    void skip_whitespace()
+    {
+        while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+            ++position;
+    }
+
+    [[noreturn]] void fail(const std::string& message) const
+    {
+        throw std::runtime_error{message + " at offset " + std::to_string(position)};
+    }
+
+    std::string text;
+    size_t position;
+};
+
+// ### Statistics ###
+double percentile(std::vector<double> values, const double fraction)
+{
+    std::sort(values.begin(), values.end());
+    const double rank = fraction * static_cast<double>(values.size() - 1);
+    const auto lower = static_cast<size_t>(std::floor(rank));
+    const auto upper = std::min(lower + 1, values.size() - 1);
+    return values[lower] + (rank - static_cast<double>(lower)) * (values[upper] - values[lower]);
+}
+
+/*
+ * One-sided Mann-Whitney U test of whether the candidate values tend to be larger than the baseline values.
+ * Returns the p-value: exact for small samples without ties, otherwise by the normal approximation with tie and
+ * continuity correction.
+ */
+double mann_whitney_p_value(const std::vector<double>& baseline, const std::vector<double>& candidate)
+{
+    const size_t n1 = candidate.size(), n2 = baseline.size();
+
+    // U counts the pairs in which the candidate is slower, ties counting half
+    double u = 0;
+    bool has_ties = false;
+    for (const double c : candidate) {
+        for (const double b : baseline) {
+            u += c > b ? 1. : c == b ? 0.5 : 0.;
+            has_ties |= c == b;
+        }
+    }
+
+    if (!has_ties && n1 + n2 <= 40) {
+        // counts[m][n][k]: orderings of m candidate and n baseline values in which k pairs have the candidate larger
+        const size_t max_u = n1 * n2;
+        std::vector<std::vector<std::vector<double>>> counts(
+                n1 + 1, std::vector<std::vector<double>>(n2 + 1, std::vector<double>(max_u + 1, 0.)));
+        for (size_t m = 0; m <= n1; ++m) {
+            for (size_t n = 0; n <= n2; ++n) {
+                if (m == 0 || n == 0) {
+                    counts[m][n][0] = 1.;
+                    continue;
+                }
+                // The largest value is either a candidate value (larger than all n baseline values) or not
+                for (size_t k = 0; k <= m * n; ++k)
+                    counts[m][n][k] = (k >= n ? counts[m - 1][n][k - n] : 0.) + counts[m][n - 1][k];
+            }
+        }
+
+        double total = 0, at_least_u = 0;
+        for (size_t k = 0; k <= max_u; ++k) {
+            total += counts[n1][n2][k];
+            if (static_cast<double>(k) >= u)
+                at_least_u += counts[n1][n2][k];
+        }
+        return at_least_u / total;
+    }
+
+    // Variance of U, corrected for ties
+    std::vector<double> all = candidate;
+    all.insert(all.end(), baseline.begin(), baseline.end());
+    std::sort(all.begin(), all.end());
+    double tie_term = 0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j] == all[i])
+            ++j;
+        const auto t = static_cast<double>(j - i);
+        tie_term += t * t * t - t;
+        i = j;
+    }
+    const auto n = static_cast<double>(n1 + n2);
+    const double mean = static_cast<double>(n1 * n2) / 2.;
+    const double variance = static_cast<double>(n1 * n2) / 12. * ((n + 1.) - tie_term / (n * (n - 1.)));
+    if (variance <= 0.)
+        return u > mean ? 0. : 1.;
+    const double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.));
+}
+
+// ### Results ###
+struct Series {
+    std::vector<double> median_samples;
+    std::vector<double> tail_samples;
+};
+
+// Name of the entry -> its samples
+using Results = std::map<std::string, Series>;
+
+void read_results(const std::string& file_name, Results& results)
+{
+    std::ifstream file { file_name };
+    if (!file)
+        throw std::runtime_error{"Result file " + file_name + " could not be read"};
+    std::stringstream content {};
+    content << file.rdbuf();
+    const JsonValue root = JsonParser { content.str() }.parse();
+
+    if (const auto benchmarks = root.find("benchmarks")) {
+        for (const auto& benchmark : benchmarks->array) {
+            const auto name = benchmark.find("name");
+            const auto samples = benchmark.find("samples");
+            if (name == nullptr || samples == nullptr || samples->array.empty())
+                throw std::runtime_error{"Benchmark without name or samples in " + file_name};
+
+            auto& series = results[name->string];
+            std::vector<double> values {};
+            for (const auto& sample : samples->array)
+                values.push_back(sample.number);
+            series.median_samples.insert(series.median_samples.end(), values.begin(), values.end());
+            series.tail_samples.push_back(percentile(values, 0.9));
+        }
+    } else if (const auto stages = root.find("stages")) {
+        for (const auto& stage : stages->array) {
+            const auto name = stage.find("name");
+            const auto p50 = stage.find("p50_ms");
+            const auto p99 = stage.find("p99_ms");
+            if (name == nullptr || p50 == nullptr || p99 == nullptr)
+                throw std::runtime_error{"Stage without name or percentiles in " + file_name};
+
+            auto& series = results[name->string];
+            series.median_samples.push_back(p50->number);
+            series.tail_samples.push_back(p99->number);
+        }
+    } else {
+        throw std::runtime_error{file_name + " contains neither benchmarks nor stages"};
+    }
+}
+
+struct Thresholds {
+    double median;          // Relative increase, e.g. 0.05 for 5%
+    double tail;
+    double alpha;           // Significance level of the test
+    size_t min_samples;     // Below this number of samples per side, the threshold alone decides
+};
+
+// Prints the comparison of one metric and returns whether it regressed
+bool compare(const std::string& name, const std::string& metric, const std::vector<double>& baseline,
+             const std::vector<double>& candidate, const double threshold, const Thresholds& thresholds)
+{
+    const double baseline_value = percentile(baseline, 0.5);
+    const double candidate_value = percentile(candidate, 0.5);
+    const double change = baseline_value > 0 ? candidate_value / baseline_value - 1. : 0.;
+
+    const bool testable = baseline.size() >= thresholds.min_samples && candidate.size() >= thresholds.min_samples;
+    const double p_value = testable ? mann_whitney_p_value(baseline, candidate) : -1.;
+    const bool regressed = change > threshold && (!testable || p_value < thresholds.alpha);
+
+    std::cout << "  " << std::left << std::setw(32) << name << std::setw(8) << metric << std::right
+              << std::fixed << std::setprecision(4) << std::setw(12) << baseline_value << std::setw(12)
+              << candidate_value << std::setprecision(1) << std::setw(9) << std::showpos << 100. * change << "%"
+              << std::noshowpos;
+    if (testable)
+        std::cout << std::setprecision(4) << std::setw(10) << p_value;
+    else
+        std::cout << std::setw(10) << "-";
+    std::cout << (regressed ? "  REGRESSION" : "") << std::endl;
+    return regressed;
+}
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options { "kfapp_compare",
+                               "Compares benchmark or stage statistics of a candidate against a baseline" };
+    options.add_options()
+            ("b,baseline", "Result file of the baseline; repeat for several runs", cxxopts::value<std::vector<std::string>>())
+            ("c,candidate", "Result file of the candidate; repeat for several runs",
+             cxxopts::value<std::vector<std::string>>())
+            ("t,threshold", "Allowed increase of the median in percent", cxxopts::value<double>()->default_value("5"))
+            ("tail-threshold", "Allowed increase of the tail latency in percent",
+             cxxopts::value<double>()->default_value("10"))
+            ("alpha", "Significance level of the Mann-Whitney U test", cxxopts::value<double>()->default_value("0.05"))
+            ("min-samples", "Samples per side needed to apply the test; with fewer, only the thresholds decide",
+             cxxopts::value<size_t>()->default_value("3"))
+            ("allow-missing", "Do not fail if entries of the baseline are missing in the candidate");
+    auto program_arguments = options.parse(argc, argv);
+    if (program_arguments.count("baseline") == 0 || program_arguments.count("candidate") == 0)
+        throw std::invalid_argument("You have to specify baseline and candidate result files");
+
+    Results baseline {}, candidate {};
+    for (const auto& file_name : program_arguments["baseline"].as<std::vector<std::string>>())
+        read_results(file_name, baseline);
+    for (const auto& file_name : program_arguments["candidate"].as<std::vector<std::string>>())
+        read_results(file_name, candidate);
+
+    const Thresholds thresholds {
+            program_arguments["threshold"].as<double>() / 100., program_arguments["tail-threshold"].as<double>() / 100.,
+            program_arguments["alpha"].as<double>(), std::max<size_t>(program_arguments["min-samples"].as<size_t>(), 1)
+    };
+
+    std::cout << "  " << std::left << std::setw(32) << "name" << std::setw(8) << "metric" << std::right
+              << std::setw(12) << "baseline" << std::setw(12) << "candidate" << std::setw(10) << "change"
+              << std::setw(10) << "p" << std::endl;
+
+    const bool allow_missing = program_arguments.count("allow-missing") > 0;
+    size_t regressions = 0, missing = 0;
+    for (const auto& entry : baseline) {
+        const auto match = candidate.find(entry.first);
+        if (match == candidate.end()) {
+            std::cout << "  " << entry.first << ": missing in candidate" << (allow_missing ? "" : "  MISSING")
+                      << std::endl;
+            ++missing;
+            continue;
+        }
+        regressions += compare(entry.first, "median", entry.second.median_samples, match->second.median_samples,
+                               thresholds.median, thresholds);
+        regressions += compare(entry.first, "tail", entry.second.tail_samples, match->second.tail_samples,
+                               thresholds.tail, thresholds);
+    }
+    for (const auto& entry : candidate) {
+        if (baseline.count(entry.first) == 0)
+            std::cout << "  " << entry.first << ": missing in baseline" << std::endl;
+    }
+
+    if (missing > 0 && !allow_missing)
+        std::cout << missing << (missing == 1 ? " entry" : " entries")
+                  << " missing in the candidate (use --allow-missing to accept)" << std::endl;
+    if (regressions > 0)
+        std::cout << regressions << " regression(s)" << std::endl;
+    if (regressions > 0 || (missing > 0 && !allow_missing))
+        return EXIT_FAILURE;
+    std::cout << "No regressions" << std::endl;
+    return EXIT_SUCCESS;
+}
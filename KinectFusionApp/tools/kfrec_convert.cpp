@@ -0,0 +1,76 @@
+/*
+ * Converts a recorded sequence as read by PseudoCamera (seq_cparam.txt, seq_depthNNNNN.png and seq_colorNNNNN.png)
+ * into a single .kfrec file, which can be replayed with camera.type = "Recording".
+ */
+
+#include <kfrec.h>
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Weffc++"
+#include <opencv2/imgcodecs.hpp>
+#pragma GCC diagnostic pop
+
+#include <cxxopts.hpp>
+
+std::string sequence_file_name(const std::string& source_path, const char* prefix, const size_t index)
+{
+    std::stringstream file_name;
+    file_name << source_path << prefix << std::setfill('0') << std::setw(5) << index << ".png";
+    return file_name.str();
+}
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options { "kfrec_convert", "Converts a directory of seq_*.png frames into a .kfrec recording" };
+    options.add_options()
+            ("i,input", "Directory containing seq_cparam.txt and the seq_*.png frames", cxxopts::value<std::string>())
+            ("o,output", "Name of the .kfrec file to create", cxxopts::value<std::string>())
+            ("rvl", "Store the depth maps RVL-compressed instead of raw");
+    auto program_arguments = options.parse(argc, argv);
+    if (program_arguments.count("input") == 0 || program_arguments.count("output") == 0)
+        throw std::invalid_argument("You have to specify an input directory and an output file");
+
+    auto source_path = program_arguments["input"].as<std::string>();
+    if (source_path.back() != '/')
+        source_path += '/';
+
+    CameraParameters cam_params {};
+    std::ifstream cam_params_stream { source_path + "seq_cparam.txt" };
+    if (!cam_params_stream.is_open())
+        throw std::runtime_error{"Camera parameters could not be read"};
+    cam_params_stream >> cam_params.image_width >> cam_params.image_height;
+    cam_params_stream >> cam_params.focal_x >> cam_params.focal_y;
+    cam_params_stream >> cam_params.principal_x >> cam_params.principal_y;
+
+    const auto depth_encoding = program_arguments.count("rvl") > 0 ? KfrecDepthEncoding::Rvl : KfrecDepthEncoding::Raw;
+    KfrecWriter writer { program_arguments["output"].as<std::string>(), cam_params, depth_encoding };
+
+    size_t frame_count = 0;
+    for (;; ++frame_count) {
+        const cv::Mat depth_map = cv::imread(sequence_file_name(source_path, "seq_depth", frame_count),
+                                             cv::IMREAD_UNCHANGED);
+        if (depth_map.empty())
+            break;
+        if (depth_map.type() != CV_16UC1)
+            throw std::runtime_error{"Depth frames have to be stored as 16 bit PNGs"};
+
+        const cv::Mat color_map = cv::imread(sequence_file_name(source_path, "seq_color", frame_count),
+                                             cv::IMREAD_COLOR);
+        writer.write_frame(depth_map, color_map);
+
+        if (frame_count % 100 == 0)
+            std::cout << "Converted " << frame_count << " frames ..." << std::endl;
+    }
+    writer.finish();
+
+    std::cout << "Converted " << frame_count << " frames" << std::endl;
+
+    return EXIT_SUCCESS;
+}